@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+/// A minimal benchmarking harness, so that the benchmarks don't need any
+/// dependencies beyond the standard library.
+namespace weak::bench {
+
+/// Command-line options shared by the benchmark programs.
+struct options
+{
+    /// Number of elements in each table.
+    size_t size = 1 << 18;
+    /// Proportion of elements that expire before measuring.
+    double expiry = 0.25;
+    /// Number of times to run each workload; the fastest run is reported.
+    size_t repeat = 3;
+    /// Only run workloads whose "table/workload" name contains this.
+    std::string filter;
+};
+
+[[noreturn]] inline void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [--size N] [--expiry RATE] [--repeat N]"
+                 " [--filter SUBSTRING]\n",
+                 program);
+    std::exit(1);
+}
+
+/// Parses the common options from the command line.
+inline options parse_options(int argc, char* argv[])
+{
+    options result;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = [&] {
+            if (++i == argc) usage(argv[0]);
+            return argv[i];
+        };
+
+        if (std::strcmp(argv[i], "--size") == 0)
+            result.size = std::strtoull(arg(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--expiry") == 0)
+            result.expiry = std::strtod(arg(), nullptr);
+        else if (std::strcmp(argv[i], "--repeat") == 0)
+            result.repeat = std::strtoull(arg(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--filter") == 0)
+            result.filter = arg();
+        else
+            usage(argv[0]);
+    }
+
+    if (result.size == 0 || result.repeat == 0 ||
+            !(0 <= result.expiry && result.expiry <= 1))
+        usage(argv[0]);
+
+    return result;
+}
+
+/// Results are accumulated here so that the compiler cannot discard the
+/// work being measured.
+inline volatile size_t sink;
+
+/// Distinct, well-scattered keys, so that identity hashes don't get an
+/// unrealistically easy ride: `key(i) == key(j)` iff `i == j` (for
+/// `i, j < 2^32`).
+inline int key(size_t i)
+{
+    return int(uint32_t(i) * uint32_t(2654435761u));
+}
+
+/// Distinct keys that look random even modulo a power of two, unlike
+/// `key`, whose low bits alone are distinct. This matters when measuring
+/// collisions under the identity hash: `scattered_key(i) ==
+/// scattered_key(j)` iff `i == j` (for `i, j < 2^32`).
+inline int scattered_key(size_t i)
+{
+    uint32_t h = uint32_t(i);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return int(h);
+}
+
+/// Chooses which of `size` elements to expire, with the given probability.
+inline std::vector<bool> choose_expired(size_t size, double rate)
+{
+    std::mt19937_64 rng(size);
+    std::bernoulli_distribution coin(rate);
+    std::vector<bool> result(size);
+    for (size_t i = 0; i < size; ++i) result[i] = coin(rng);
+    return result;
+}
+
+/// Prints the header for `report`.
+inline void report_header(const options& opts)
+{
+    std::printf("# size = %zu, expiry = %.2f, repeat = %zu\n",
+                opts.size, opts.expiry, opts.repeat);
+    std::printf("%-32s %-16s %12s %12s\n",
+                "table", "workload", "ops", "ns/op");
+}
+
+/// Prints one result line.
+inline void report(const char* table, const char* workload,
+                   size_t ops, double ns)
+{
+    std::printf("%-32s %-16s %12zu %12.2f\n",
+                table, workload, ops, ops? ns / ops : 0.0);
+    std::fflush(stdout);
+}
+
+/// Runs a workload `opts.repeat` times and reports the fastest run.
+///
+/// Each run calls `setup()` to build fresh state (untimed) and then
+/// `run(state)` (timed), which should return the number of operations it
+/// performed.
+template <class Setup, class Run>
+void measure(const options& opts,
+             const char* table, const char* workload,
+             Setup setup, Run run)
+{
+    if (!opts.filter.empty() &&
+            (std::string(table) + "/" + workload).find(opts.filter)
+                == std::string::npos)
+        return;
+
+    using clock = std::chrono::steady_clock;
+
+    double best = std::numeric_limits<double>::infinity();
+    size_t ops  = 0;
+
+    for (size_t r = 0; r < opts.repeat; ++r) {
+        auto state = setup();
+        auto start = clock::now();
+        ops = run(state);
+        auto stop = clock::now();
+        best = std::min(best,
+                        std::chrono::duration<double, std::nano>(
+                                stop - start).count());
+    }
+
+    report(table, workload, ops, best);
+}
+
+} // end namespace weak::bench
@@ -0,0 +1,136 @@
+// Measures how lookup throughput scales with the number of reader threads
+// for the thread-safe tables, at roughly 1000 lookups per insert.
+
+#include "bench.h"
+
+#include "concurrent_weak_unordered_set.h"
+#include "read_mostly_weak_unordered_set.h"
+#include "weak_unordered_set.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace weak;
+using namespace weak::bench;
+
+namespace {
+
+// How many lookups each thread makes per insert.
+constexpr size_t reads_per_write = 1000;
+
+// A weak_unordered_set behind a single mutex, as a baseline.
+struct locked_set
+{
+    std::mutex mutex;
+    weak_unordered_set<int> set;
+
+    bool member(int k)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return set.member(k);
+    }
+
+    void insert(const std::shared_ptr<const int>& p)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        set.insert(p);
+    }
+
+    template <class It>
+    void insert(It first, It last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        set.insert(first, last);
+    }
+};
+
+struct sharded_set
+{
+    concurrent_weak_unordered_set<int> set;
+
+    bool member(int k) { return set.member(k); }
+    void insert(const std::shared_ptr<const int>& p) { set.insert(p); }
+
+    template <class It>
+    void insert(It first, It last)
+    {
+        for (; first != last; ++first) set.insert(*first);
+    }
+};
+
+struct read_mostly_set
+{
+    read_mostly_weak_unordered_set<int> set;
+
+    bool member(int k) { return set.member(k); }
+    void insert(const std::shared_ptr<const int>& p) { set.insert(p); }
+
+    template <class It>
+    void insert(It first, It last) { set.insert(first, last); }
+};
+
+template <class Set>
+void run_scaling(const options& opts, const char* name, size_t max_threads)
+{
+    std::vector<std::shared_ptr<const int>> holders;
+    for (size_t i = 0; i < opts.size; ++i)
+        holders.push_back(std::make_shared<const int>(key(i)));
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        std::string workload = "find x" + std::to_string(threads);
+        size_t per_thread = std::max(opts.size, size_t(1) << 20);
+
+        measure(opts, name, workload.c_str(),
+                [&] {
+                    auto set = std::make_unique<Set>();
+                    set->insert(holders.begin(), holders.end());
+                    return set;
+                },
+                [&](auto& set) {
+                    std::vector<std::thread> pool;
+                    std::vector<std::shared_ptr<const int>> extra(threads);
+                    std::vector<size_t> hits(threads);
+
+                    for (size_t t = 0; t < threads; ++t) {
+                        pool.emplace_back([&, t] {
+                            size_t count = 0;
+                            for (size_t i = 0; i < per_thread; ++i) {
+                                size_t j = (i * 7919 + t) % opts.size;
+                                count += set->member(key(j));
+                                if (i % reads_per_write == t) {
+                                    extra[t] = std::make_shared<const int>(
+                                            key(opts.size + t));
+                                    set->insert(extra[t]);
+                                }
+                            }
+                            hits[t] = count;
+                        });
+                    }
+
+                    for (auto& th : pool) th.join();
+                    for (size_t h : hits) sink = sink + h;
+                    return threads * per_thread;
+                });
+    }
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    options opts = parse_options(argc, argv);
+    report_header(opts);
+
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    run_scaling<locked_set>(opts, "locked weak_unordered_set", max_threads);
+    run_scaling<sharded_set>(opts, "concurrent_weak_unordered_set",
+                             max_threads);
+    run_scaling<read_mostly_set>(opts, "read_mostly_weak_unordered_set",
+                                 max_threads);
+}
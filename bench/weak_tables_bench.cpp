@@ -0,0 +1,777 @@
+// Benchmarks the four weak hash tables against standard-library baselines.
+//
+// Every table is driven through the same workloads by a small adapter
+// struct, which knows how to build the strong objects that keep its
+// elements alive ("holders") and how to perform each operation.
+
+#include "bench.h"
+
+#include "intrusive_ptr.h"
+#include "local_ptr.h"
+#include "weak_unordered_set.h"
+#include "weak_key_unordered_map.h"
+#include "weak_value_unordered_map.h"
+#include "weak_weak_unordered_map.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace weak;
+using namespace weak::bench;
+
+namespace {
+
+// Adapters for the weak hash tables.
+
+template <class Table>
+struct weak_table_adapter
+{
+    using table = Table;
+
+    static void reserve(table& t, size_t n)
+    {
+        t.reserve(n);
+    }
+
+    static void remove_expired(table& t)
+    {
+        t.remove_expired();
+    }
+
+    template <class Holder>
+    static bool find(const table& t, int k, const Holder&)
+    {
+        return t.find(k) != t.end();
+    }
+
+    template <class Holder>
+    static void erase(table& t, int k, const Holder&)
+    {
+        t.erase(k);
+    }
+};
+
+/// Allocates a key the way that its kind of strong pointer wants.
+template <class Ptr>
+Ptr make_pointer(int k)
+{
+    using element = typename Ptr::element_type;
+
+    if constexpr (std::is_same_v<Ptr, std::shared_ptr<element>>)
+        return std::make_shared<element>(k);
+    else if constexpr (std::is_same_v<Ptr, local_shared_ptr<element>>)
+        return make_local_shared<element>(k);
+    else
+        return make_intrusive<element>(k);
+}
+
+template <class Table>
+struct basic_set_adapter : weak_table_adapter<Table>
+{
+    using table  = Table;
+    using holder = typename Table::strong_value_type;
+
+    static holder make(int k)
+    {
+        return make_pointer<holder>(k);
+    }
+
+    static bool live(const holder& h)
+    {
+        return h != nullptr;
+    }
+
+    static void insert(table& t, int, const holder& h)
+    {
+        t.insert(h);
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& ptr : t) result += *ptr;
+        return result;
+    }
+
+    template <class View>
+    static size_t read(const View& view)
+    {
+        return *view;
+    }
+};
+
+struct set_adapter : basic_set_adapter<weak_unordered_set<int>>
+{
+    static constexpr const char* name = "weak_unordered_set";
+};
+
+struct pow2_set_adapter
+        : basic_set_adapter<weak_unordered_set<int, std::hash<int>,
+                                               std::equal_to<>,
+                                               std::allocator<int>,
+                                               power_of_two_policy>>
+{
+    static constexpr const char* name = "weak_unordered_set<pow2>";
+};
+
+struct swiss_set_adapter
+        : basic_set_adapter<weak_unordered_set<int, std::hash<int>,
+                                               std::equal_to<>,
+                                               std::allocator<int>,
+                                               swiss_policy>>
+{
+    static constexpr const char* name = "weak_unordered_set<swiss>";
+};
+
+struct intrusive_set_adapter
+        : basic_set_adapter<weak_unordered_set<int, std::hash<int>,
+                                               std::equal_to<>,
+                                               std::allocator<int>,
+                                               intrusive_policy>>
+{
+    static constexpr const char* name = "weak_unordered_set<intrusive>";
+};
+
+struct local_set_adapter : basic_set_adapter<local::weak_unordered_set<int>>
+{
+    static constexpr const char* name = "local::weak_unordered_set";
+};
+
+struct key_map_adapter : weak_table_adapter<weak_key_unordered_map<int, int>>
+{
+    static constexpr const char* name = "weak_key_unordered_map";
+
+    using holder = std::shared_ptr<const int>;
+
+    static holder make(int k)
+    {
+        return std::make_shared<const int>(k);
+    }
+
+    static bool live(const holder& h)
+    {
+        return h != nullptr;
+    }
+
+    static void insert(table& t, int k, const holder& h)
+    {
+        t.insert({h, k});
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& pair : t) result += pair.second;
+        return result;
+    }
+
+    static size_t iterate_arrow(const table& t)
+    {
+        size_t result = 0;
+        for (auto iter = t.begin(); iter != t.end(); ++iter)
+            result += iter->second;
+        return result;
+    }
+
+    template <class View>
+    static size_t read(const View& view)
+    {
+        return view.second;
+    }
+};
+
+struct value_map_adapter
+        : weak_table_adapter<weak_value_unordered_map<int, int>>
+{
+    static constexpr const char* name = "weak_value_unordered_map";
+
+    using holder = std::shared_ptr<int>;
+
+    static holder make(int k)
+    {
+        return std::make_shared<int>(k);
+    }
+
+    static bool live(const holder& h)
+    {
+        return h != nullptr;
+    }
+
+    static void insert(table& t, int k, const holder& h)
+    {
+        t.insert({k, h});
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& pair : t) result += *pair.second;
+        return result;
+    }
+
+    static size_t iterate_arrow(const table& t)
+    {
+        size_t result = 0;
+        for (auto iter = t.begin(); iter != t.end(); ++iter)
+            result += *iter->second;
+        return result;
+    }
+
+    template <class View>
+    static size_t read(const View& view)
+    {
+        return *view.second;
+    }
+};
+
+struct weak_map_adapter
+        : weak_table_adapter<weak_weak_unordered_map<int, int>>
+{
+    static constexpr const char* name = "weak_weak_unordered_map";
+
+    using holder = std::pair<std::shared_ptr<const int>, std::shared_ptr<int>>;
+
+    static holder make(int k)
+    {
+        return {std::make_shared<const int>(k), std::make_shared<int>(k)};
+    }
+
+    static bool live(const holder& h)
+    {
+        return h.first != nullptr;
+    }
+
+    static void insert(table& t, int, const holder& h)
+    {
+        t.insert(h);
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& pair : t) result += *pair.second;
+        return result;
+    }
+
+    static size_t iterate_arrow(const table& t)
+    {
+        size_t result = 0;
+        for (auto iter = t.begin(); iter != t.end(); ++iter)
+            result += *iter->second;
+        return result;
+    }
+
+    template <class View>
+    static size_t read(const View& view)
+    {
+        return *view.second;
+    }
+};
+
+// Baselines built from standard containers.
+
+/// `std::unordered_map` to `std::weak_ptr`s, cleaned up by hand.
+struct std_unordered_map_adapter
+{
+    static constexpr const char* name = "std::unordered_map<K, weak_ptr>";
+
+    using table  = std::unordered_map<int, std::weak_ptr<int>>;
+    using holder = std::shared_ptr<int>;
+
+    static holder make(int k)
+    {
+        return std::make_shared<int>(k);
+    }
+
+    static bool live(const holder& h)
+    {
+        return h != nullptr;
+    }
+
+    static void reserve(table& t, size_t n)
+    {
+        t.reserve(n);
+    }
+
+    static void insert(table& t, int k, const holder& h)
+    {
+        t.insert_or_assign(k, h);
+    }
+
+    static bool find(const table& t, int k, const holder&)
+    {
+        auto iter = t.find(k);
+        return iter != t.end() && iter->second.lock() != nullptr;
+    }
+
+    static void erase(table& t, int k, const holder&)
+    {
+        t.erase(k);
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& [k, weak] : t)
+            if (auto ptr = weak.lock()) result += *ptr;
+        return result;
+    }
+
+    static void remove_expired(table& t)
+    {
+        for (auto iter = t.begin(); iter != t.end(); ) {
+            if (iter->second.expired())
+                iter = t.erase(iter);
+            else
+                ++iter;
+        }
+    }
+};
+
+/// `std::set` of `std::weak_ptr`s ordered by ownership.
+///
+/// This can only look elements up by pointer, not by key, so it's a
+/// baseline for identity sets rather than a drop-in replacement.
+struct std_owner_set_adapter
+{
+    static constexpr const char* name = "std::set<weak_ptr, owner_less>";
+
+    using table  = std::set<std::weak_ptr<const int>, std::owner_less<>>;
+    using holder = std::shared_ptr<const int>;
+
+    static holder make(int k)
+    {
+        return std::make_shared<const int>(k);
+    }
+
+    static bool live(const holder& h)
+    {
+        return h != nullptr;
+    }
+
+    static void reserve(table&, size_t)
+    { }
+
+    static void insert(table& t, int, const holder& h)
+    {
+        t.insert(h);
+    }
+
+    static bool find(const table& t, int, const holder& h)
+    {
+        auto iter = t.find(h);
+        return iter != t.end() && iter->lock() != nullptr;
+    }
+
+    static void erase(table& t, int, const holder& h)
+    {
+        auto iter = t.find(h);
+        if (iter != t.end()) t.erase(iter);
+    }
+
+    static size_t iterate(const table& t)
+    {
+        size_t result = 0;
+        for (const auto& weak : t)
+            if (auto ptr = weak.lock()) result += *ptr;
+        return result;
+    }
+
+    static void remove_expired(table& t)
+    {
+        for (auto iter = t.begin(); iter != t.end(); ) {
+            if (iter->expired())
+                iter = t.erase(iter);
+            else
+                ++iter;
+        }
+    }
+};
+
+// The workloads.
+
+template <class Adapter>
+struct fixture
+{
+    typename Adapter::table table;
+    // Element `i` has key `key(i)`; its holder is reset if it has expired.
+    std::vector<typename Adapter::holder> holders;
+    // Holders for keys `key(size + i)`, which are never inserted.
+    std::vector<typename Adapter::holder> strangers;
+};
+
+template <class Adapter>
+std::vector<typename Adapter::holder> make_holders(size_t start, size_t count)
+{
+    std::vector<typename Adapter::holder> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        result.push_back(Adapter::make(key(start + i)));
+    return result;
+}
+
+/// A fixture whose table contains `opts.size` elements, of which about
+/// `opts.expiry` have expired.
+template <class Adapter>
+fixture<Adapter> populated(const options& opts)
+{
+    fixture<Adapter> result;
+    result.holders = make_holders<Adapter>(0, opts.size);
+    result.strangers = make_holders<Adapter>(opts.size, opts.size);
+
+    for (size_t i = 0; i < opts.size; ++i)
+        Adapter::insert(result.table, key(i), result.holders[i]);
+
+    auto expired = choose_expired(opts.size, opts.expiry);
+    for (size_t i = 0; i < opts.size; ++i)
+        if (expired[i]) result.holders[i] = {};
+
+    return result;
+}
+
+template <class Adapter>
+void run_all(const options& opts)
+{
+    using fixture_t = fixture<Adapter>;
+    const char* name = Adapter::name;
+    size_t size = opts.size;
+
+    // Inserting into a default-sized table, so growth is included.
+    measure(opts, name, "growth",
+            [&] {
+                fixture_t f;
+                f.holders = make_holders<Adapter>(0, size);
+                return f;
+            },
+            [&](fixture_t& f) {
+                for (size_t i = 0; i < size; ++i)
+                    Adapter::insert(f.table, key(i), f.holders[i]);
+                return size;
+            });
+
+    // Inserting into a table that has already been reserved.
+    measure(opts, name, "insert",
+            [&] {
+                fixture_t f;
+                f.holders = make_holders<Adapter>(0, size);
+                Adapter::reserve(f.table, size);
+                return f;
+            },
+            [&](fixture_t& f) {
+                for (size_t i = 0; i < size; ++i)
+                    Adapter::insert(f.table, key(i), f.holders[i]);
+                return size;
+            });
+
+    measure(opts, name, "find-hit",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                size_t ops = 0, found = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    if (Adapter::live(f.holders[i])) {
+                        found += Adapter::find(f.table, key(i), f.holders[i]);
+                        ++ops;
+                    }
+                }
+                sink = found;
+                return ops;
+            });
+
+    measure(opts, name, "find-miss",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                size_t found = 0;
+                for (size_t i = 0; i < size; ++i)
+                    found += Adapter::find(f.table, key(size + i),
+                                           f.strangers[i]);
+                sink = found;
+                return size;
+            });
+
+    measure(opts, name, "erase",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                size_t ops = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    if (Adapter::live(f.holders[i])) {
+                        Adapter::erase(f.table, key(i), f.holders[i]);
+                        ++ops;
+                    }
+                }
+                return ops;
+            });
+
+    measure(opts, name, "iterate",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                sink = Adapter::iterate(f.table);
+                return size;
+            });
+
+    measure(opts, name, "remove_expired",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                Adapter::remove_expired(f.table);
+                return size;
+            });
+}
+
+/// Probe cost at a range of load factors, with nothing expired.
+///
+/// Each table gets a fixed power-of-two bucket count (the least one with
+/// room for `opts.size` elements) and a maximum load factor high enough
+/// that it never grows, and is then filled to the given load factor. Keys
+/// are scattered so that modulo indexing sees collisions too.
+template <class Adapter>
+void run_probe(const options& opts)
+{
+    using table_t = typename Adapter::table;
+    const char* name = Adapter::name;
+
+    size_t buckets = 1;
+    while (buckets < opts.size) buckets <<= 1;
+
+    for (double load : {0.5, 0.6, 0.7, 0.8, 0.9, 0.95}) {
+        size_t size = size_t(load * buckets);
+
+        struct state
+        {
+            table_t table;
+            std::vector<typename Adapter::holder> holders, strangers;
+        };
+
+        auto setup = [&] {
+            state result{table_t(buckets), {}, {}};
+            result.table.max_load_factor(0.99);
+            for (size_t i = 0; i < size; ++i) {
+                result.holders.push_back(Adapter::make(scattered_key(i)));
+                result.strangers.push_back(
+                        Adapter::make(scattered_key(size + i)));
+                Adapter::insert(result.table, scattered_key(i),
+                                result.holders[i]);
+            }
+            return result;
+        };
+
+        char hit[32], miss[32];
+        std::snprintf(hit, sizeof hit, "probe-hit@%.2f", load);
+        std::snprintf(miss, sizeof miss, "probe-miss@%.2f", load);
+
+        measure(opts, name, hit, setup,
+                [&](state& s) {
+                    size_t found = 0;
+                    for (size_t i = 0; i < size; ++i)
+                        found += Adapter::find(s.table, scattered_key(i),
+                                               s.holders[i]);
+                    sink = found;
+                    return size;
+                });
+
+        measure(opts, name, miss, setup,
+                [&](state& s) {
+                    size_t found = 0;
+                    for (size_t i = 0; i < size; ++i)
+                        found += Adapter::find(s.table,
+                                               scattered_key(size + i),
+                                               s.strangers[i]);
+                    sink = found;
+                    return size;
+                });
+    }
+}
+
+/// Loading a whole vector of holders with one range insert, into an empty
+/// table and into one that already holds as many other elements; and then
+/// looking up every key in one batched call.
+template <class Adapter>
+void run_bulk(const options& opts)
+{
+    using fixture_t = fixture<Adapter>;
+    const char* name = Adapter::name;
+    size_t size = opts.size;
+
+    measure(opts, name, "bulk-insert",
+            [&] {
+                fixture_t f;
+                f.holders = make_holders<Adapter>(0, size);
+                return f;
+            },
+            [&](fixture_t& f) {
+                f.table.insert(f.holders.begin(), f.holders.end());
+                return size;
+            });
+
+    measure(opts, name, "bulk-insert-nonempty",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                f.table.insert(f.strangers.begin(), f.strangers.end());
+                return size;
+            });
+
+    std::vector<int> keys;
+    for (size_t i = 0; i < size; ++i) keys.push_back(key(i));
+
+    measure(opts, name, "find-many",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                std::vector<bool> found;
+                found.reserve(size);
+                f.table.member_many(keys.begin(), keys.end(),
+                                    std::back_inserter(found));
+                sink = found.size();
+                return size;
+            });
+}
+
+/// Iterating with `iter->second` rather than a range `for`, which costs
+/// whatever `operator->` does on top of dereferencing.
+template <class Adapter>
+void run_arrow(const options& opts)
+{
+    using fixture_t = fixture<Adapter>;
+
+    measure(opts, Adapter::name, "iterate-arrow",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                sink = Adapter::iterate_arrow(f.table);
+                return opts.size;
+            });
+}
+
+// Reading elements by looking them up and then dereferencing, which locks
+// each one twice, versus lending them to a callback, which locks once.
+template <class Adapter>
+void run_visit(const options& opts)
+{
+    using fixture_t = fixture<Adapter>;
+    const char* name = Adapter::name;
+    size_t size = opts.size;
+
+    measure(opts, name, "find-read",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                const auto& table = f.table;
+                size_t ops = 0, total = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    if (Adapter::live(f.holders[i])) {
+                        auto iter = table.find(key(i));
+                        if (iter != table.end()) total += Adapter::read(*iter);
+                        ++ops;
+                    }
+                }
+                sink = total;
+                return ops;
+            });
+
+    measure(opts, name, "with",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                const auto& table = f.table;
+                size_t ops = 0, total = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    if (Adapter::live(f.holders[i])) {
+                        table.with(key(i), [&](const auto& view) {
+                            total += Adapter::read(view);
+                        });
+                        ++ops;
+                    }
+                }
+                sink = total;
+                return ops;
+            });
+
+    measure(opts, name, "for-each-live",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                size_t total = 0;
+                f.table.for_each_live([&](const auto& view) {
+                    total += Adapter::read(view);
+                });
+                sink = total;
+                return size;
+            });
+}
+
+// Sweeping and growing on as many threads as the hardware runs at once, to
+// compare with the serial remove_expired and growth.
+template <class Adapter>
+void run_parallel(const options& opts)
+{
+    using fixture_t = fixture<Adapter>;
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    measure(opts, Adapter::name, "remove_expired-par",
+            [&] { return populated<Adapter>(opts); },
+            [&](fixture_t& f) {
+                f.table.remove_expired(threads);
+                return opts.size;
+            });
+
+    if constexpr (std::is_same_v<typename Adapter::table::policy_type,
+                                 default_table_policy>) {
+        // Inserting into a default-sized table, growing on all threads.
+        measure(opts, Adapter::name, "growth-par",
+                [&] {
+                    fixture_t f;
+                    f.holders = make_holders<Adapter>(0, opts.size);
+                    f.table.resize_threads(threads);
+                    return f;
+                },
+                [&](fixture_t& f) {
+                    for (size_t i = 0; i < opts.size; ++i)
+                        Adapter::insert(f.table, key(i), f.holders[i]);
+                    return opts.size;
+                });
+    }
+}
+
+} // end anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    options opts = parse_options(argc, argv);
+    report_header(opts);
+
+    run_all<set_adapter>(opts);
+    run_all<pow2_set_adapter>(opts);
+    run_all<swiss_set_adapter>(opts);
+    run_all<intrusive_set_adapter>(opts);
+    run_all<local_set_adapter>(opts);
+    run_all<key_map_adapter>(opts);
+    run_all<value_map_adapter>(opts);
+    run_all<weak_map_adapter>(opts);
+    run_all<std_unordered_map_adapter>(opts);
+    run_all<std_owner_set_adapter>(opts);
+
+    run_bulk<set_adapter>(opts);
+    run_bulk<pow2_set_adapter>(opts);
+    run_bulk<swiss_set_adapter>(opts);
+
+    run_arrow<key_map_adapter>(opts);
+    run_arrow<value_map_adapter>(opts);
+    run_arrow<weak_map_adapter>(opts);
+
+    run_visit<set_adapter>(opts);
+    run_visit<swiss_set_adapter>(opts);
+    run_visit<key_map_adapter>(opts);
+    run_visit<value_map_adapter>(opts);
+    run_visit<weak_map_adapter>(opts);
+
+    run_parallel<set_adapter>(opts);
+    run_parallel<swiss_set_adapter>(opts);
+    run_parallel<key_map_adapter>(opts);
+
+    run_probe<set_adapter>(opts);
+    run_probe<pow2_set_adapter>(opts);
+    run_probe<swiss_set_adapter>(opts);
+    run_probe<intrusive_set_adapter>(opts);
+    run_probe<local_set_adapter>(opts);
+    run_probe<key_map_adapter>(opts);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "detail/sharded_table.h"
+#include "weak_key_unordered_map.h"
+
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace weak {
+
+/// A thread-safe map whose keys are stored by `std::weak_ptr`s.
+///
+/// Like `concurrent_weak_unordered_set`, keys are partitioned among
+/// independently locked shards, each a `weak_key_unordered_map`. Since a
+/// reference into the map could be invalidated by another thread at any
+/// time, lookups return copies of the values.
+template<class Key, class T,
+         class Hash = std::hash<Key>,
+         class KeyEqual = std::equal_to<>,
+         class Allocator = std::allocator<weak_key_pair<Key, T>>,
+         class Policy = default_table_policy>
+class concurrent_weak_key_unordered_map
+{
+    using table_type = weak_key_unordered_map<Key, T, Hash, KeyEqual,
+                                              Allocator, Policy>;
+
+public:
+    using key_type       = Key;
+    /// The strong pointers to keys that the map takes in.
+    using key_pointer    = typename table_type::key_pointer;
+    using mapped_type    = T;
+    using hasher         = Hash;
+    using key_equal      = KeyEqual;
+    using allocator_type = Allocator;
+    using policy_type    = Policy;
+
+    /// The default number of shards.
+    static constexpr size_t default_shard_count = 16;
+
+    /// Constructs an empty map with the given number of shards, which is
+    /// rounded up to a power of two.
+    explicit concurrent_weak_key_unordered_map(
+        size_t shard_count = default_shard_count,
+        const hasher& hash = hasher(),
+        const key_equal& equal = key_equal(),
+        const allocator_type& allocator = allocator_type())
+            : shards_(shard_count, table_type::default_bucket_count,
+                      hash, equal, allocator)
+    { }
+
+    /// The number of shards.
+    size_t shard_count() const
+    {
+        return shards_.shard_count();
+    }
+
+    /// The total size of the shards, which is only a snapshot if other
+    /// threads are modifying the map, and counts associations whose keys
+    /// have expired but not been removed.
+    size_t size() const
+    {
+        size_t result = 0;
+        shards_.for_each_shard([&](const table_type& table) {
+            result += table.size();
+        });
+        return result;
+    }
+
+    /// Is the given key mapped?
+    template <class KeyLike>
+    bool member(const KeyLike& key) const
+    {
+        return shards_.with_shard(key, [&](const table_type& table) {
+            return table.member(key);
+        });
+    }
+
+    /// Returns a copy of the value that the given key maps to, if any.
+    template <class KeyLike>
+    std::optional<mapped_type> find(const KeyLike& key) const
+    {
+        return shards_.with_shard(key, [&](const table_type& table) {
+            auto iter = table.find(key);
+            if (iter == table.end())
+                return std::optional<mapped_type>();
+            else
+                return std::optional<mapped_type>((*iter).second);
+        });
+    }
+
+    /// Maps `key` to `value`, replacing any previous value.
+    void insert(const key_pointer& key, mapped_type value)
+    {
+        shards_.with_shard(*key, [&](table_type& table) {
+            table.insert({key, std::move(value)});
+        });
+    }
+
+    /// Returns a copy of the value that `key` maps to if there is one, or
+    /// otherwise maps it to `make()`, which is called with the shard
+    /// locked, and returns a copy of that.
+    template <class Make>
+    mapped_type get_or_insert(const key_pointer& key, Make make)
+    {
+        return shards_.with_shard(*key, [&](table_type& table) {
+            auto iter = table.find(*key);
+            if (iter != table.end()) return mapped_type((*iter).second);
+
+            mapped_type result = make();
+            table.insert({key, result});
+            return result;
+        });
+    }
+
+    /// Erases the association for the given key, returning whether there
+    /// was one.
+    bool erase(const key_type& key)
+    {
+        return shards_.with_shard(key, [&](table_type& table) {
+            return table.erase(key);
+        });
+    }
+
+    /// Removes all associations.
+    void clear()
+    {
+        shards_.for_each_shard([](table_type& table) {
+            table.clear();
+        });
+    }
+
+    /// Cleans up expired associations, locking one shard at a time.
+    void remove_expired()
+    {
+        shards_.for_each_shard([](table_type& table) {
+            table.remove_expired();
+        });
+    }
+
+    /// Cleans up expired associations in only the given shard, so that the
+    /// work can be spread out or shared among threads.
+    ///
+    /// *PRECONDITION*: `shard_index < shard_count()`
+    void remove_expired_in_shard(size_t shard_index)
+    {
+        shards_.with_shard_at(shard_index, [](table_type& table) {
+            table.remove_expired();
+        });
+    }
+
+private:
+    detail::sharded_table<table_type> shards_;
+};
+
+} // end namespace weak
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "detail/sharded_table.h"
+#include "weak_unordered_set.h"
+
+#include <memory>
+
+namespace weak {
+
+/// A thread-safe unordered set of weak pointers.
+///
+/// Keys are partitioned by hash code among a fixed number of shards, each
+/// a `weak_unordered_set` guarded by its own mutex and kept on its own
+/// cache line, so threads contend only when they touch the same shard.
+///
+/// Because other threads may change the set at any time, there are no
+/// iterators; lookups return strong pointers instead.
+template <
+    class Key,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>,
+    class Policy = default_table_policy
+>
+class concurrent_weak_unordered_set
+{
+    using table_type = weak_unordered_set<Key, Hash, KeyEqual, Allocator,
+                                          Policy>;
+
+public:
+    using key_type       = Key;
+    /// The strong pointers that the set hands out and takes in.
+    using value_type     = typename table_type::strong_value_type;
+    using hasher         = Hash;
+    using key_equal      = KeyEqual;
+    using allocator_type = Allocator;
+    using policy_type    = Policy;
+
+    /// The default number of shards.
+    static constexpr size_t default_shard_count = 16;
+
+    /// Constructs an empty set with the given number of shards, which is
+    /// rounded up to a power of two.
+    explicit concurrent_weak_unordered_set(
+        size_t shard_count = default_shard_count,
+        const hasher& hash = hasher(),
+        const key_equal& equal = key_equal(),
+        const allocator_type& allocator = allocator_type())
+            : shards_(shard_count, table_type::default_bucket_count,
+                      hash, equal, allocator)
+    { }
+
+    /// The number of shards.
+    size_t shard_count() const
+    {
+        return shards_.shard_count();
+    }
+
+    /// The total size of the shards, which is only a snapshot if other
+    /// threads are modifying the set, and, as with `weak_unordered_set`,
+    /// counts elements that have expired but not been removed.
+    size_t size() const
+    {
+        size_t result = 0;
+        shards_.for_each_shard([&](const table_type& table) {
+            result += table.size();
+        });
+        return result;
+    }
+
+    /// Is the given key in the set?
+    template <class KeyLike>
+    bool member(const KeyLike& key) const
+    {
+        return shards_.with_shard(key, [&](const table_type& table) {
+            return table.member(key);
+        });
+    }
+
+    /// Returns the element equal to the given key, or `nullptr` if there
+    /// isn't one.
+    template <class KeyLike>
+    value_type find(const KeyLike& key) const
+    {
+        return shards_.with_shard(key, [&](const table_type& table) {
+            auto iter = table.find(key);
+            return iter == table.end()? value_type() : *iter;
+        });
+    }
+
+    /// Inserts an element, replacing any equal element.
+    void insert(const value_type& value)
+    {
+        shards_.with_shard(*value, [&](table_type& table) {
+            table.insert(value);
+        });
+    }
+
+    /// Returns the element equal to `value` if there is one, or otherwise
+    /// inserts and returns `value`.
+    ///
+    /// Interning with this is atomic: threads that race to insert equal
+    /// values all get back the same pointer.
+    value_type get_or_insert(const value_type& value)
+    {
+        return get_or_insert(*value, [&] { return value; });
+    }
+
+    /// Returns the element equal to `key` if there is one, or otherwise
+    /// inserts and returns the result of calling `make()`, which is called
+    /// with the shard locked.
+    ///
+    /// *PRECONDITION*: `make()` returns a pointer to a key equal to `key`
+    template <class KeyLike, class Make>
+    value_type get_or_insert(const KeyLike& key, Make make)
+    {
+        return shards_.with_shard(key, [&](table_type& table) {
+            auto iter = table.find(key);
+            if (iter != table.end()) return value_type(*iter);
+
+            value_type result = make();
+            table.insert(result);
+            return result;
+        });
+    }
+
+    /// Erases the element equal to the given key, returning whether there
+    /// was one.
+    bool erase(const key_type& key)
+    {
+        return shards_.with_shard(key, [&](table_type& table) {
+            return table.erase(key);
+        });
+    }
+
+    /// Removes all elements.
+    void clear()
+    {
+        shards_.for_each_shard([](table_type& table) {
+            table.clear();
+        });
+    }
+
+    /// Cleans up expired elements, locking one shard at a time.
+    void remove_expired()
+    {
+        shards_.for_each_shard([](table_type& table) {
+            table.remove_expired();
+        });
+    }
+
+    /// Cleans up expired elements in only the given shard, so that the
+    /// work can be spread out or shared among threads.
+    ///
+    /// *PRECONDITION*: `shard_index < shard_count()`
+    void remove_expired_in_shard(size_t shard_index)
+    {
+        shards_.with_shard_at(shard_index, [](table_type& table) {
+            table.remove_expired();
+        });
+    }
+
+private:
+    detail::sharded_table<table_type> shards_;
+};
+
+} // end namespace weak
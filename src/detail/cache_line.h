@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+namespace weak::detail {
+
+/// The assumed size of a cache line, for keeping data that different
+/// threads write apart.
+constexpr size_t cache_line_size = 64;
+
+} // end namespace weak::detail
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define WEAK_DETAIL_CONTROL_GROUP_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+namespace weak::detail {
+
+/// A control byte, describing one slot of a `weak_swiss_table_base`.
+///
+/// Full slots hold the low seven bits of their hash code, so they are
+/// non-negative; empty and deleted slots are negative.
+using ctrl_t = signed char;
+
+/// The control byte of a slot that has never been filled.
+constexpr ctrl_t ctrl_empty = -128;
+
+/// The control byte of a slot whose element was erased (a tombstone).
+constexpr ctrl_t ctrl_deleted = -2;
+
+/// Is the slot with the given control byte full?
+constexpr bool ctrl_is_full(ctrl_t c) noexcept
+{
+    return c >= 0;
+}
+
+/// The index of the lowest set bit of a non-zero mask.
+inline unsigned lowest_bit_index(uint32_t mask) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return unsigned(__builtin_ctz(mask));
+#else
+    unsigned result = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++result;
+    }
+    return result;
+#endif
+}
+
+/// The index of the highest set bit of a non-zero mask.
+inline unsigned highest_bit_index(uint32_t mask) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 31 - unsigned(__builtin_clz(mask));
+#else
+    unsigned result = 31;
+    while (!(mask & (uint32_t(1) << 31))) {
+        mask <<= 1;
+        --result;
+    }
+    return result;
+#endif
+}
+
+/// A bitmask with one bit per slot of a group, which can be iterated over
+/// to visit the set bits from lowest to highest.
+class group_mask
+{
+public:
+    /// The number of slots in a group.
+    static constexpr unsigned width = 16;
+
+    explicit group_mask(uint32_t mask) noexcept
+            : mask_(mask)
+    { }
+
+    /// Are any bits set?
+    explicit operator bool() const noexcept
+    {
+        return mask_ != 0;
+    }
+
+    /// Removes and returns the index of the lowest set bit.
+    ///
+    /// *PRECONDITION*: some bit is set
+    unsigned pop() noexcept
+    {
+        unsigned result = lowest_bit_index(mask_);
+        mask_ &= mask_ - 1;
+        return result;
+    }
+
+    /// The number of unset bits below the lowest set bit.
+    unsigned trailing_zeros() const noexcept
+    {
+        return mask_? lowest_bit_index(mask_) : width;
+    }
+
+    /// The number of unset bits above the highest set bit.
+    unsigned leading_zeros() const noexcept
+    {
+        return mask_? width - 1 - highest_bit_index(mask_) : width;
+    }
+
+private:
+    uint32_t mask_;
+};
+
+/// A window of `width` consecutive control bytes, which can be searched
+/// all at once: with SSE2 if available, and by a portable loop otherwise.
+class control_group
+{
+public:
+    /// The number of control bytes in a group.
+    static constexpr size_t width = group_mask::width;
+
+    /// Loads the group starting at `pos`, which need not be aligned.
+    explicit control_group(const ctrl_t* pos) noexcept
+#ifdef WEAK_DETAIL_CONTROL_GROUP_SSE2
+            : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos)))
+    { }
+#else
+    {
+        for (size_t i = 0; i < width; ++i) ctrl_[i] = pos[i];
+    }
+#endif
+
+    /// The slots whose control byte is `tag`.
+    group_mask match(ctrl_t tag) const noexcept
+    {
+#ifdef WEAK_DETAIL_CONTROL_GROUP_SSE2
+        return group_mask(uint32_t(_mm_movemask_epi8(
+                _mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(tag)))));
+#else
+        uint32_t result = 0;
+        for (size_t i = 0; i < width; ++i)
+            if (ctrl_[i] == tag) result |= uint32_t(1) << i;
+        return group_mask(result);
+#endif
+    }
+
+    /// The empty slots.
+    group_mask match_empty() const noexcept
+    {
+        return match(ctrl_empty);
+    }
+
+    /// The empty or deleted slots, i.e., those available for inserting.
+    group_mask match_empty_or_deleted() const noexcept
+    {
+#ifdef WEAK_DETAIL_CONTROL_GROUP_SSE2
+        // Exactly the negative bytes, whose sign bits movemask collects.
+        return group_mask(uint32_t(_mm_movemask_epi8(ctrl_)));
+#else
+        uint32_t result = 0;
+        for (size_t i = 0; i < width; ++i)
+            if (!ctrl_is_full(ctrl_[i])) result |= uint32_t(1) << i;
+        return group_mask(result);
+#endif
+    }
+
+private:
+#ifdef WEAK_DETAIL_CONTROL_GROUP_SSE2
+    __m128i ctrl_;
+#else
+    ctrl_t ctrl_[width];
+#endif
+};
+
+} // end namespace weak::detail
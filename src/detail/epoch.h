@@ -0,0 +1,162 @@
+#pragma once
+
+#include "cache_line.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace weak::detail {
+
+/// Epoch-based reclamation, for freeing objects that lock-free readers may
+/// still be looking at.
+///
+/// Readers hold a `guard` (from `pin()`) while they access shared objects.
+/// A writer first makes an object unreachable to new readers and then
+/// `retire`s it, and the object is deleted once every reader that might
+/// have seen it has dropped its guard.
+///
+/// Each reader counts itself in for the epoch that it pins. The global
+/// epoch advances only once no reader remains from the epoch before the
+/// current one, so when the epoch reaches `e + 2`, nobody can still be
+/// looking at an object retired in epoch `e`.
+class epoch_domain
+{
+public:
+    /// The number of reader counters. Threads are spread among them, and
+    /// sharing a counter is safe but makes those threads contend.
+    static constexpr size_t slot_count = 64;
+
+    /// Keeps the calling thread in the epoch that it pinned.
+    class guard
+    {
+    public:
+        guard(guard&& other) noexcept
+                : counter_(std::exchange(other.counter_, nullptr))
+        { }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard()
+        {
+            if (counter_) counter_->fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        friend class epoch_domain;
+
+        explicit guard(std::atomic<size_t>* counter)
+                : counter_(counter)
+        { }
+
+        std::atomic<size_t>* counter_;
+    };
+
+    epoch_domain() = default;
+
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+
+    /// Deletes all retired objects.
+    ///
+    /// *PRECONDITION*: no thread holds a guard
+    ~epoch_domain() = default;
+
+    /// Pins the current epoch until the returned guard is destroyed.
+    guard pin()
+    {
+        slot& s = slots_[thread_slot_()];
+
+        for (;;) {
+            uint64_t epoch = epoch_.load();
+            auto& counter = s.readers[epoch & 1];
+            counter.fetch_add(1);
+
+            // If the epoch moved on before we were counted, a writer may
+            // have missed us, so try again in the new epoch.
+            if (epoch_.load() == epoch) return guard(&counter);
+
+            counter.fetch_sub(1);
+        }
+    }
+
+    /// Deletes `object` once no reader can be looking at it.
+    ///
+    /// *PRECONDITION*: `object` is no longer reachable by new readers
+    template <class T>
+    void retire(T* object)
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        retired_.push_back({epoch_.load(),
+                            retired_ptr(object, [](void* p) {
+                                delete static_cast<T*>(p);
+                            })});
+        reclaim_();
+    }
+
+    /// Deletes whatever retired objects are no longer visible to readers.
+    void reclaim()
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        reclaim_();
+    }
+
+private:
+    using retired_ptr = std::unique_ptr<void, void(*)(void*)>;
+
+    struct alignas(cache_line_size) slot
+    {
+        // Readers in even epochs count themselves in `readers[0]`, and
+        // readers in odd epochs in `readers[1]`.
+        std::atomic<size_t> readers[2] {};
+    };
+
+    static size_t thread_slot_()
+    {
+        static std::atomic<size_t> next_slot {0};
+        thread_local size_t slot_index =
+            next_slot.fetch_add(1, std::memory_order_relaxed) % slot_count;
+        return slot_index;
+    }
+
+    // Advances the epoch if no reader remains from the previous one.
+    // Requires `retire_mutex_`.
+    bool try_advance_()
+    {
+        uint64_t epoch = epoch_.load();
+
+        // The previous epoch has the other parity.
+        for (const slot& s : slots_)
+            if (s.readers[(epoch + 1) & 1].load() != 0) return false;
+
+        epoch_.store(epoch + 1);
+        return true;
+    }
+
+    // Requires `retire_mutex_`.
+    void reclaim_()
+    {
+        // Two advances are enough to free everything if there are no
+        // readers about.
+        if (try_advance_()) try_advance_();
+
+        uint64_t epoch = epoch_.load();
+        auto first_kept = retired_.begin();
+        while (first_kept != retired_.end() && first_kept->first + 2 <= epoch)
+            ++first_kept;
+        retired_.erase(retired_.begin(), first_kept);
+    }
+
+    alignas(cache_line_size) std::atomic<uint64_t> epoch_ {0};
+    slot slots_[slot_count];
+
+    std::mutex retire_mutex_;
+    // In order of retirement, and thus of epoch.
+    std::vector<std::pair<uint64_t, retired_ptr>> retired_;
+};
+
+} // end namespace weak::detail
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace weak::detail {
+
+/// The hash codes of tracked elements that have expired, as reported by
+/// their deleters, waiting for their table to erase them.
+///
+/// Tracked objects may die on any thread, so recording takes a lock. The
+/// table checks `pending()` first, so it only locks when there's something
+/// to take.
+class expiry_log
+{
+public:
+    /// Records that an element with the given hash code has expired, unless
+    /// the table has gone away.
+    void record(size_t hash_code)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (detached_) return;
+        hash_codes_.push_back(hash_code);
+        pending_.store(true, std::memory_order_release);
+    }
+
+    /// Are there any hash codes to take?
+    bool pending() const
+    {
+        return pending_.load(std::memory_order_acquire);
+    }
+
+    /// Takes the recorded hash codes, leaving the log empty.
+    std::vector<size_t> take()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.store(false, std::memory_order_relaxed);
+        return std::exchange(hash_codes_, {});
+    }
+
+    /// Stops recording, for when the table is destroyed.
+    void detach()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        detached_ = true;
+        pending_.store(false, std::memory_order_relaxed);
+        hash_codes_.clear();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<size_t> hash_codes_;
+    std::atomic<bool> pending_ {false};
+    bool detached_ = false;
+};
+
+/// Deletes a tracked object and then reports its hash code to the log.
+template <class U>
+struct tracked_deleter
+{
+    std::shared_ptr<expiry_log> log;
+    size_t hash_code;
+
+    void operator()(U* object) const
+    {
+        delete object;
+        log->record(hash_code);
+    }
+};
+
+} // end namespace weak::detail
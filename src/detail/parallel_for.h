@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace weak::detail {
+
+/// The executor that the tables' parallel operations use by default: it
+/// calls `task(i)` for each `i` in `[0, tasks)` on a thread of its own,
+/// except `task(0)`, which runs on the calling thread, and returns once
+/// they have all finished.
+///
+/// A task that can't get a thread, because the system won't start one or
+/// there's no memory to keep track of it, runs on the calling thread
+/// instead, so this throws only what the tasks do. (Tables rely on that to
+/// run tasks partway through moving their elements.)
+struct thread_per_task
+{
+    template <class Task>
+    void operator()(size_t tasks, Task& task) const
+    {
+        std::vector<std::thread> threads;
+
+        for (size_t i = 1; i < tasks; ++i) {
+            try {
+                threads.emplace_back([&task, i] { task(i); });
+            } catch (...) {
+                task(i);
+            }
+        }
+
+        if (tasks > 0) task(0);
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+};
+
+} // end namespace weak::detail
@@ -0,0 +1,17 @@
+#pragma once
+
+namespace weak::detail {
+
+/// Hints that the memory at `address` will be read soon, so that a batch
+/// of probes can wait on their cache misses together rather than one at a
+/// time. This is a no-op on compilers we don't know how to ask.
+inline void prefetch(const void* address) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void) address;
+#endif
+}
+
+} // end namespace weak::detail
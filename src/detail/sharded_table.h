@@ -0,0 +1,125 @@
+#pragma once
+
+#include "cache_line.h"
+#include "../weak_table_policy.h"
+
+#include <climits>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace weak::detail {
+
+/// A fixed number of weak hash tables, each guarded by its own mutex, with
+/// keys partitioned among them by hash code.
+///
+/// This provides the locking for the concurrent tables; operations on a
+/// single key lock only the shard that the key belongs to.
+template <class Table>
+class sharded_table
+{
+public:
+    using table_type     = Table;
+    using hasher         = typename table_type::hasher;
+    using key_equal      = typename table_type::key_equal;
+    using allocator_type = typename table_type::allocator_type;
+
+    /// Constructs `shard_count` empty shards (rounded up to a power of
+    /// two), each with the given initial bucket count.
+    sharded_table(size_t shard_count,
+                  size_t bucket_count,
+                  const hasher& hash,
+                  const key_equal& equal,
+                  const allocator_type& allocator)
+            : hasher_(hash)
+            , shard_bits_(0)
+    {
+        while ((size_t(1) << shard_bits_) < shard_count) ++shard_bits_;
+
+        shards_.reset(new shard[this->shard_count()]);
+        for (size_t i = 0; i < this->shard_count(); ++i) {
+            shards_[i].table = table_type(bucket_count, hash, equal, allocator);
+        }
+    }
+
+    /// The number of shards.
+    size_t shard_count() const
+    {
+        return size_t(1) << shard_bits_;
+    }
+
+    /// The index of the shard that holds `key`.
+    template <class KeyLike>
+    size_t shard_index(const KeyLike& key) const
+    {
+        if (shard_bits_ == 0) return 0;
+
+        // The tables index buckets by the low bits of the hash code, so
+        // we use the high bits, after mixing in case the hasher is weak.
+        size_t hash_code = power_of_two_indexing::mix(hasher_(key));
+        return hash_code >> (sizeof(size_t) * CHAR_BIT - shard_bits_);
+    }
+
+    /// Calls `f` on the shard that holds `key`, while holding its lock.
+    template <class KeyLike, class F>
+    decltype(auto) with_shard(const KeyLike& key, F f)
+    {
+        return with_shard_at(shard_index(key), f);
+    }
+
+    /// Calls `f` on the shard that holds `key`, while holding its lock.
+    template <class KeyLike, class F>
+    decltype(auto) with_shard(const KeyLike& key, F f) const
+    {
+        return with_shard_at(shard_index(key), f);
+    }
+
+    /// Calls `f` on the given shard, while holding its lock.
+    template <class F>
+    decltype(auto) with_shard_at(size_t index, F f)
+    {
+        shard& s = shards_[index];
+        std::lock_guard<std::mutex> guard(s.mutex);
+        return f(s.table);
+    }
+
+    /// Calls `f` on the given shard, while holding its lock.
+    template <class F>
+    decltype(auto) with_shard_at(size_t index, F f) const
+    {
+        const shard& s = shards_[index];
+        std::lock_guard<std::mutex> guard(s.mutex);
+        return f(s.table);
+    }
+
+    /// Calls `f` on each shard in turn, holding only that shard's lock.
+    template <class F>
+    void for_each_shard(F f)
+    {
+        for (size_t i = 0; i < shard_count(); ++i)
+            with_shard_at(i, f);
+    }
+
+    /// Calls `f` on each shard in turn, holding only that shard's lock.
+    template <class F>
+    void for_each_shard(F f) const
+    {
+        for (size_t i = 0; i < shard_count(); ++i)
+            with_shard_at(i, f);
+    }
+
+private:
+    // Each shard gets its own cache lines, so that threads working on
+    // different shards don't contend over the mutexes.
+    struct alignas(cache_line_size) shard
+    {
+        mutable std::mutex mutex;
+        table_type table;
+    };
+
+    hasher hasher_;
+    size_t shard_bits_;
+    std::unique_ptr<shard[]> shards_;
+};
+
+} // end namespace weak::detail
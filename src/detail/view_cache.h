@@ -0,0 +1,86 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+
+namespace weak::detail {
+
+/// Where an iterator keeps the view it locked its current element into.
+///
+/// Views may hold references, which `std::optional` would assign through,
+/// so this assigns by destroying its view and constructing a new one.
+template <class T>
+class view_cache
+{
+public:
+    view_cache() = default;
+
+    view_cache(const view_cache& other)
+    {
+        if (other) value_.emplace(*other.value_);
+    }
+
+    view_cache(view_cache&& other)
+    {
+        if (other) value_.emplace(std::move(*other.value_));
+    }
+
+    /// Caches a view converted from another cache's, as from an
+    /// `iterator`'s to a `const_iterator`'s.
+    template <class U>
+    explicit view_cache(const view_cache<U>& other)
+    {
+        if (other) value_.emplace(*other);
+    }
+
+    view_cache& operator=(const view_cache& other)
+    {
+        if (this != &other) {
+            value_.reset();
+            if (other) value_.emplace(*other.value_);
+        }
+
+        return *this;
+    }
+
+    view_cache& operator=(view_cache&& other)
+    {
+        if (this != &other) {
+            value_.reset();
+            if (other) value_.emplace(std::move(*other.value_));
+        }
+
+        return *this;
+    }
+
+    void emplace(T&& value)
+    {
+        value_.reset();
+        value_.emplace(std::move(value));
+    }
+
+    void reset() noexcept
+    {
+        value_.reset();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return value_.has_value();
+    }
+
+    const T& operator*() const noexcept
+    {
+        return *value_;
+    }
+
+    const T* operator->() const noexcept
+    {
+        return &*value_;
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+} // end namespace weak::detail
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+namespace weak::detail {
+
+/// Calls a visitor on `view`, returning whether to go on to the next one.
+///
+/// Visitors may return `void`, to see everything, or something that
+/// converts to `bool`, which is `false` to stop early.
+template <class Visitor, class View>
+bool visit_and_continue(Visitor& visitor, const View& view)
+{
+    if constexpr (std::is_void_v<std::invoke_result_t<Visitor&, const View&>>) {
+        visitor(view);
+        return true;
+    } else {
+        return bool(visitor(view));
+    }
+}
+
+} // end namespace weak::detail
@@ -0,0 +1,537 @@
+#pragma once
+
+#include "weak_table_policy.h"
+#include "weak_traits.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace weak {
+
+namespace detail {
+
+/// A reference count that threads may share.
+class atomic_ref_count
+{
+public:
+    explicit atomic_ref_count(size_t initial) noexcept
+            : count_(initial)
+    { }
+
+    size_t load() const noexcept
+    {
+        return count_.load(std::memory_order_acquire);
+    }
+
+    void increment() noexcept
+    {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Increments the count unless it's 0.
+    bool try_increment() noexcept
+    {
+        size_t count = count_.load(std::memory_order_relaxed);
+
+        while (count != 0) {
+            if (count_.compare_exchange_weak(count, count + 1,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed))
+                return true;
+        }
+
+        return false;
+    }
+
+    /// Decrements the count, returning whether it reached 0.
+    bool decrement() noexcept
+    {
+        return count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+private:
+    std::atomic<size_t> count_;
+};
+
+/// A reference count for objects confined to one thread.
+class local_ref_count
+{
+public:
+    explicit local_ref_count(size_t initial) noexcept
+            : count_(initial)
+    { }
+
+    size_t load() const noexcept
+    {
+        return count_;
+    }
+
+    void increment() noexcept
+    {
+        ++count_;
+    }
+
+    /// Increments the count unless it's 0.
+    bool try_increment() noexcept
+    {
+        if (count_ == 0) return false;
+        ++count_;
+        return true;
+    }
+
+    /// Decrements the count, returning whether it reached 0.
+    bool decrement() noexcept
+    {
+        return --count_ == 0;
+    }
+
+private:
+    size_t count_;
+};
+
+/// An object allocated by `make_intrusive`, preceded by its reference
+/// counts in the same allocation.
+///
+/// The weak count includes one reference on behalf of all the strong
+/// references, so the box is freed when the last strong or weak reference
+/// goes, whichever is later. The object itself is destroyed when the last
+/// strong reference goes.
+template <class T, class Count>
+class intrusive_box
+{
+public:
+    template <class... Args>
+    explicit intrusive_box(Args&&... args)
+    {
+        ::new (static_cast<void*>(storage_)) T(std::forward<Args>(args)...);
+    }
+
+    intrusive_box(const intrusive_box&) = delete;
+    intrusive_box& operator=(const intrusive_box&) = delete;
+
+    T* object() noexcept
+    {
+        return std::launder(reinterpret_cast<T*>(storage_));
+    }
+
+    size_t use_count() const noexcept
+    {
+        return strong_.load();
+    }
+
+    bool expired() const noexcept
+    {
+        return strong_.load() == 0;
+    }
+
+    void add_strong() noexcept
+    {
+        strong_.increment();
+    }
+
+    /// Adds a strong reference unless the object is already gone.
+    bool try_add_strong() noexcept
+    {
+        return strong_.try_increment();
+    }
+
+    void release_strong() noexcept
+    {
+        bool last_strong = strong_.decrement();
+        if (last_strong) {
+            object()->~T();
+            release_weak();
+        }
+    }
+
+    void add_weak() noexcept
+    {
+        weak_.increment();
+    }
+
+    /// Drops a weak reference, freeing the box if it was the last one.
+    /// Nothing may touch the box after this returns.
+    void release_weak() noexcept
+    {
+        bool last_weak = weak_.decrement();
+        if (last_weak) delete this;
+    }
+
+private:
+    ~intrusive_box() = default;
+
+    Count strong_ {1};
+    Count weak_ {1};
+    alignas(T) unsigned char storage_[sizeof(T)];
+};
+
+} // end namespace detail
+
+template <class T, class Count = detail::atomic_ref_count>
+class intrusive_ptr;
+
+template <class T, class Count = detail::atomic_ref_count>
+class intrusive_weak_ptr;
+
+template <class T, class Count, class... Args>
+intrusive_ptr<T, Count> make_counted(Args&&... args);
+
+/// A reference-counted pointer whose counts live in the same allocation
+/// as the object, right before it.
+///
+/// Unlike `std::shared_ptr`, this is one word wide and has no separate
+/// control block to allocate or chase. The price is that objects must be
+/// created by `make_intrusive`, and that an `intrusive_ptr<T>` converts
+/// only to `intrusive_ptr<const T>`, not to pointers to base classes.
+///
+/// The counts are atomic by default; `Count` may be
+/// `detail::local_ref_count` instead for objects that never leave one
+/// thread (see `local_shared_ptr`).
+template <class T, class Count>
+class intrusive_ptr
+{
+    using box_type = detail::intrusive_box<std::remove_const_t<T>, Count>;
+
+public:
+    using element_type = T;
+
+    /// Constructs a null pointer.
+    constexpr intrusive_ptr() noexcept
+            : box_(nullptr)
+    { }
+
+    /// Constructs a null pointer.
+    constexpr intrusive_ptr(std::nullptr_t) noexcept
+            : intrusive_ptr()
+    { }
+
+    /// Copy constructor.
+    intrusive_ptr(const intrusive_ptr& other) noexcept
+            : box_(other.box_)
+    {
+        if (box_) box_->add_strong();
+    }
+
+    /// Move constructor.
+    intrusive_ptr(intrusive_ptr&& other) noexcept
+            : box_(std::exchange(other.box_, nullptr))
+    { }
+
+    /// Converts a pointer to non-const into a pointer to const.
+    template <class U, class = std::enable_if_t<
+            std::is_same_v<const U, T> && !std::is_const_v<U>>>
+    intrusive_ptr(const intrusive_ptr<U, Count>& other) noexcept
+            : box_(other.box_)
+    {
+        if (box_) box_->add_strong();
+    }
+
+    /// Converts a pointer to non-const into a pointer to const.
+    template <class U, class = std::enable_if_t<
+            std::is_same_v<const U, T> && !std::is_const_v<U>>>
+    intrusive_ptr(intrusive_ptr<U, Count>&& other) noexcept
+            : box_(std::exchange(other.box_, nullptr))
+    { }
+
+    /// Destructor.
+    ~intrusive_ptr()
+    {
+        if (box_) box_->release_strong();
+    }
+
+    /// Copy-assignment.
+    intrusive_ptr& operator=(const intrusive_ptr& other) noexcept
+    {
+        intrusive_ptr(other).swap(*this);
+        return *this;
+    }
+
+    /// Move-assignment.
+    intrusive_ptr& operator=(intrusive_ptr&& other) noexcept
+    {
+        intrusive_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    /// Makes this pointer null.
+    void reset() noexcept
+    {
+        intrusive_ptr().swap(*this);
+    }
+
+    /// Swaps two pointers.
+    void swap(intrusive_ptr& other) noexcept
+    {
+        std::swap(box_, other.box_);
+    }
+
+    /// The object pointed to, or `nullptr`.
+    T* get() const noexcept
+    {
+        return box_? box_->object() : nullptr;
+    }
+
+    /// Dereferences the pointer.
+    T& operator*() const noexcept
+    {
+        return *get();
+    }
+
+    /// Dereferences the pointer.
+    T* operator->() const noexcept
+    {
+        return get();
+    }
+
+    /// Is this pointer non-null?
+    explicit operator bool() const noexcept
+    {
+        return box_ != nullptr;
+    }
+
+    /// The number of `intrusive_ptr`s sharing the object, or 0 if null.
+    size_t use_count() const noexcept
+    {
+        return box_? box_->use_count() : 0;
+    }
+
+private:
+    explicit intrusive_ptr(box_type* box) noexcept
+            : box_(box)
+    { }
+
+    box_type* box_;
+
+    template <class U, class C> friend class intrusive_ptr;
+    template <class U, class C> friend class intrusive_weak_ptr;
+    template <class U, class C, class... Args>
+    friend intrusive_ptr<U, C> make_counted(Args&&... args);
+};
+
+/// A weak pointer to an object managed by `intrusive_ptr`s.
+template <class T, class Count>
+class intrusive_weak_ptr
+{
+    using box_type = detail::intrusive_box<std::remove_const_t<T>, Count>;
+
+public:
+    using element_type = T;
+
+    /// Constructs an expired weak pointer.
+    constexpr intrusive_weak_ptr() noexcept
+            : box_(nullptr)
+    { }
+
+    /// Copy constructor.
+    intrusive_weak_ptr(const intrusive_weak_ptr& other) noexcept
+            : box_(other.box_)
+    {
+        if (box_) box_->add_weak();
+    }
+
+    /// Move constructor.
+    intrusive_weak_ptr(intrusive_weak_ptr&& other) noexcept
+            : box_(std::exchange(other.box_, nullptr))
+    { }
+
+    /// Constructs a weak pointer to the object of a strong pointer.
+    template <class U, class = std::enable_if_t<
+            std::is_same_v<std::remove_const_t<U>, std::remove_const_t<T>> &&
+            std::is_convertible_v<U*, T*>>>
+    intrusive_weak_ptr(const intrusive_ptr<U, Count>& other) noexcept
+            : box_(other.box_)
+    {
+        if (box_) box_->add_weak();
+    }
+
+    /// Converts a weak pointer to non-const into a weak pointer to const.
+    template <class U, class = std::enable_if_t<
+            std::is_same_v<const U, T> && !std::is_const_v<U>>>
+    intrusive_weak_ptr(const intrusive_weak_ptr<U, Count>& other) noexcept
+            : box_(other.box_)
+    {
+        if (box_) box_->add_weak();
+    }
+
+    /// Destructor.
+    ~intrusive_weak_ptr()
+    {
+        if (box_) box_->release_weak();
+    }
+
+    /// Copy-assignment.
+    intrusive_weak_ptr& operator=(const intrusive_weak_ptr& other) noexcept
+    {
+        intrusive_weak_ptr(other).swap(*this);
+        return *this;
+    }
+
+    /// Move-assignment.
+    intrusive_weak_ptr& operator=(intrusive_weak_ptr&& other) noexcept
+    {
+        intrusive_weak_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    /// Points this at the object of a strong pointer.
+    template <class U>
+    intrusive_weak_ptr& operator=(const intrusive_ptr<U, Count>& other) noexcept
+    {
+        intrusive_weak_ptr(other).swap(*this);
+        return *this;
+    }
+
+    /// Makes this pointer expired.
+    void reset() noexcept
+    {
+        intrusive_weak_ptr().swap(*this);
+    }
+
+    /// Swaps two weak pointers.
+    void swap(intrusive_weak_ptr& other) noexcept
+    {
+        std::swap(box_, other.box_);
+    }
+
+    /// Has the object been destroyed (or was there never one)?
+    bool expired() const noexcept
+    {
+        return !box_ || box_->expired();
+    }
+
+    /// Returns a strong pointer to the object, or a null pointer if it has
+    /// expired.
+    intrusive_ptr<T, Count> lock() const noexcept
+    {
+        if (box_ && box_->try_add_strong())
+            return intrusive_ptr<T, Count>(box_);
+        else
+            return nullptr;
+    }
+
+private:
+    box_type* box_;
+
+    template <class U, class C> friend class intrusive_weak_ptr;
+};
+
+/// Allocates and constructs an object managed by `intrusive_ptr`s with
+/// the given kind of count.
+template <class T, class Count, class... Args>
+intrusive_ptr<T, Count> make_counted(Args&&... args)
+{
+    using box_type = typename intrusive_ptr<T, Count>::box_type;
+    return intrusive_ptr<T, Count>(new box_type(std::forward<Args>(args)...));
+}
+
+/// Allocates and constructs an object managed by `intrusive_ptr`s.
+template <class T, class... Args>
+intrusive_ptr<T> make_intrusive(Args&&... args)
+{
+    return make_counted<T, detail::atomic_ref_count>(
+            std::forward<Args>(args)...);
+}
+
+/// Pointer equality.
+template <class T, class U, class Count>
+bool operator==(const intrusive_ptr<T, Count>& a,
+                const intrusive_ptr<U, Count>& b) noexcept
+{
+    return a.get() == b.get();
+}
+
+/// Pointer disequality.
+template <class T, class U, class Count>
+bool operator!=(const intrusive_ptr<T, Count>& a,
+                const intrusive_ptr<U, Count>& b) noexcept
+{
+    return a.get() != b.get();
+}
+
+/// Is the pointer null?
+template <class T, class Count>
+bool operator==(const intrusive_ptr<T, Count>& a, std::nullptr_t) noexcept
+{
+    return !a;
+}
+
+/// Is the pointer null?
+template <class T, class Count>
+bool operator==(std::nullptr_t, const intrusive_ptr<T, Count>& a) noexcept
+{
+    return !a;
+}
+
+/// Is the pointer non-null?
+template <class T, class Count>
+bool operator!=(const intrusive_ptr<T, Count>& a, std::nullptr_t) noexcept
+{
+    return bool(a);
+}
+
+/// Is the pointer non-null?
+template <class T, class Count>
+bool operator!=(std::nullptr_t, const intrusive_ptr<T, Count>& a) noexcept
+{
+    return bool(a);
+}
+
+/// Specialization for storing `intrusive_weak_ptr<T>`, where `T` may be
+/// const.
+template <class T, class Count>
+struct weak_traits<intrusive_weak_ptr<T, Count>>
+{
+    using strong_type = intrusive_ptr<T, Count>;
+    using view_type = strong_type;
+    using const_view_type = view_type;
+    using key_type = T;
+
+    static const_view_type view(const strong_type& strong)
+    {
+        return strong;
+    }
+
+    static const key_type* key(const_view_type& view)
+    {
+        return view.get();
+    }
+
+    static bool live(const view_type& view)
+    {
+        return view != nullptr;
+    }
+
+    static const key_type& strong_key(const strong_type& strong)
+    {
+        return *strong;
+    }
+
+    static strong_type move(view_type& view)
+    {
+        return std::move(view);
+    }
+};
+
+/// A policy for building the tables on `intrusive_weak_ptr`s, so that
+/// they take and hand out `intrusive_ptr`s.
+struct intrusive_policy : default_table_policy
+{
+    template <class T>
+    using weak_pointer = intrusive_weak_ptr<T>;
+};
+
+} // end namespace weak
+
+/// Hashes `intrusive_ptr`s by address, like `std::shared_ptr`s.
+template <class T, class Count>
+struct std::hash<weak::intrusive_ptr<T, Count>>
+{
+    size_t operator()(const weak::intrusive_ptr<T, Count>& ptr) const noexcept
+    {
+        return std::hash<T*>()(ptr.get());
+    }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "intrusive_ptr.h"
+#include "weak_key_unordered_map.h"
+#include "weak_table_policy.h"
+#include "weak_unordered_set.h"
+#include "weak_value_unordered_map.h"
+#include "weak_weak_unordered_map.h"
+
+#include <functional>
+#include <memory>
+
+namespace weak {
+
+/// A reference-counted pointer for objects that never leave one thread.
+///
+/// This is an `intrusive_ptr` whose counts are plain integers, so copying,
+/// dropping, and locking weak pointers cost no atomic read-modify-writes.
+/// Sharing one of these objects among threads, even read-only, is a data
+/// race.
+template <class T>
+using local_shared_ptr = intrusive_ptr<T, detail::local_ref_count>;
+
+/// A weak pointer to an object managed by `local_shared_ptr`s.
+template <class T>
+using local_weak_ptr = intrusive_weak_ptr<T, detail::local_ref_count>;
+
+/// Allocates and constructs an object managed by `local_shared_ptr`s.
+template <class T, class... Args>
+local_shared_ptr<T> make_local_shared(Args&&... args)
+{
+    return make_counted<T, detail::local_ref_count>(
+            std::forward<Args>(args)...);
+}
+
+/// A policy for building the tables on `local_weak_ptr`s, so that they
+/// take and hand out `local_shared_ptr`s.
+struct local_policy : default_table_policy
+{
+    template <class T>
+    using weak_pointer = local_weak_ptr<T>;
+};
+
+/// The weak hash tables on `local_weak_ptr`s, for thread-confined use such
+/// as per-worker interners and caches.
+namespace local {
+
+/// A `weak::weak_unordered_set` of `local_weak_ptr`s.
+template <
+    class Key,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>,
+    class Policy = local_policy
+>
+using weak_unordered_set =
+    weak::weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>;
+
+/// A `weak::weak_key_unordered_map` whose keys are `local_weak_ptr`s.
+template <
+    class Key, class T,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>,
+    class Policy = local_policy
+>
+using weak_key_unordered_map =
+    weak::weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>;
+
+/// A `weak::weak_value_unordered_map` whose values are `local_weak_ptr`s.
+template <
+    class Key, class T,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>,
+    class Policy = local_policy
+>
+using weak_value_unordered_map =
+    weak::weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>;
+
+/// A `weak::weak_weak_unordered_map` of `local_weak_ptr`s.
+template <
+    class Key, class T,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>,
+    class Policy = local_policy
+>
+using weak_weak_unordered_map =
+    weak::weak_weak_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>;
+
+} // end namespace local
+
+} // end namespace weak
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "detail/epoch.h"
+#include "weak_unordered_set.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace weak {
+
+/// A thread-safe unordered set of weak pointers, for when lookups vastly
+/// outnumber changes.
+///
+/// Readers never lock. They probe immutable `weak_unordered_set`s, with
+/// the default Robin Hood layout, that are published through an atomic
+/// pointer: a large snapshot, and a small table of elements inserted since
+/// the snapshot was taken. Writers take turns copying whichever table they
+/// change and publishing the copy, and the tables they replace are freed by
+/// epoch-based reclamation once no reader can be looking at them.
+///
+/// Once the recent table grows past about the square root of the
+/// snapshot's size, it is merged into a new snapshot, so inserting takes
+/// amortized time proportional to that square root; use the range `insert`
+/// to insert many elements at once. Erasing, or inserting an element that
+/// replaces a live element of the snapshot, copies the snapshot.
+template <
+    class Key,
+    class Hash = std::hash<Key>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<Key>
+>
+class read_mostly_weak_unordered_set
+{
+    using table_type = weak_unordered_set<Key, Hash, KeyEqual, Allocator>;
+
+public:
+    using key_type       = Key;
+    /// The strong pointers that the set hands out and takes in.
+    using value_type     = std::shared_ptr<const Key>;
+    using hasher         = Hash;
+    using key_equal      = KeyEqual;
+    using allocator_type = Allocator;
+
+    /// Constructs an empty set.
+    explicit read_mostly_weak_unordered_set(
+        size_t bucket_count = table_type::default_bucket_count,
+        const hasher& hash = hasher(),
+        const key_equal& equal = key_equal(),
+        const allocator_type& allocator = allocator_type())
+    {
+        auto snapshot = new table_type(bucket_count, hash, equal, allocator);
+        version_.store(new version{snapshot, empty_like_(*snapshot)});
+    }
+
+    read_mostly_weak_unordered_set(const read_mostly_weak_unordered_set&)
+        = delete;
+    read_mostly_weak_unordered_set&
+    operator=(const read_mostly_weak_unordered_set&) = delete;
+
+    /// Destructor.
+    ///
+    /// *PRECONDITION*: no other thread is using the set
+    ~read_mostly_weak_unordered_set()
+    {
+        version* current = version_.load();
+        delete current->snapshot;
+        delete current->recent;
+        delete current;
+    }
+
+    /// The number of elements, including any that have expired but not
+    /// been removed.
+    size_t size() const
+    {
+        auto guard = epoch_.pin();
+        const version* current = version_.load();
+        return current->snapshot->size() + current->recent->size();
+    }
+
+    /// Is the given key in the set? Never locks.
+    template <class KeyLike>
+    bool member(const KeyLike& key) const
+    {
+        auto guard = epoch_.pin();
+        const version* current = version_.load();
+        return current->snapshot->member(key) || current->recent->member(key);
+    }
+
+    /// Returns the element equal to the given key, or `nullptr` if there
+    /// isn't one. Never locks.
+    template <class KeyLike>
+    value_type find(const KeyLike& key) const
+    {
+        auto guard = epoch_.pin();
+        const version* current = version_.load();
+        if (auto found = find_in_(*current->snapshot, key)) return found;
+        return find_in_(*current->recent, key);
+    }
+
+    /// Inserts an element, replacing any equal element.
+    void insert(const value_type& value)
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        insert_(&value, &value + 1);
+    }
+
+    /// Inserts a range of elements, copying each table at most once.
+    template <class InputIt>
+    void insert(InputIt first, InputIt last)
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        insert_(first, last);
+    }
+
+    /// Returns the element equal to `value` if there is one, or otherwise
+    /// inserts and returns `value`. Only locks if `value` is new.
+    value_type get_or_insert(const value_type& value)
+    {
+        if (auto found = find(*value)) return found;
+
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+
+        // Another writer may have beaten us to it.
+        if (auto found = find(*value)) return found;
+
+        insert_(&value, &value + 1);
+        return value;
+    }
+
+    /// Erases the element equal to the given key, returning whether there
+    /// was one.
+    bool erase(const key_type& key)
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+
+        const version* current = version_.load();
+        table_type* snapshot = current->snapshot;
+        table_type* recent = current->recent;
+
+        if (recent->member(key)) {
+            recent = new table_type(*recent);
+            recent->erase(key);
+        } else if (snapshot->member(key)) {
+            snapshot = new table_type(*snapshot);
+            snapshot->erase(key);
+        } else {
+            return false;
+        }
+
+        publish_(snapshot, recent);
+        return true;
+    }
+
+    /// Removes all elements.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+
+        const version* current = version_.load();
+        publish_(empty_like_(*current->snapshot),
+                 empty_like_(*current->recent));
+    }
+
+    /// Cleans up expired elements, merging recent insertions into a new
+    /// snapshot.
+    void remove_expired()
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+
+        const version* current = version_.load();
+        auto snapshot = new table_type(*current->snapshot);
+        snapshot->remove_expired();
+        snapshot->insert(current->recent->begin(), current->recent->end());
+        publish_(snapshot, empty_like_(*current->recent));
+    }
+
+private:
+    // A published pair of tables. An element is live in at most one.
+    struct version
+    {
+        table_type* snapshot;
+        table_type* recent;
+    };
+
+    template <class KeyLike>
+    static value_type find_in_(const table_type& table, const KeyLike& key)
+    {
+        auto iter = table.find(key);
+        return iter == table.end()? value_type() : *iter;
+    }
+
+    static table_type* empty_like_(const table_type& table)
+    {
+        return new table_type(table_type::default_bucket_count,
+                              table.hash_function(),
+                              table.key_eq(),
+                              table.get_allocator());
+    }
+
+    // The rest require `writer_mutex_`, which is what lets them read
+    // `version_` without pinning.
+
+    template <class InputIt>
+    void insert_(InputIt first, InputIt last)
+    {
+        const version* current = version_.load();
+        table_type* snapshot = current->snapshot;
+        auto recent = std::make_unique<table_type>(*current->recent);
+
+        for (; first != last; ++first) {
+            value_type value(*first);
+
+            // Replacing a live element of the snapshot has to happen there,
+            // since readers look in the snapshot first.
+            if (current->snapshot->member(*value)) {
+                if (snapshot == current->snapshot)
+                    snapshot = new table_type(*snapshot);
+                snapshot->insert(value);
+            } else {
+                recent->insert(value);
+            }
+        }
+
+        size_t threshold = 32;
+        while (threshold * threshold < snapshot->size()) threshold *= 2;
+
+        // Merge once the recent table is big enough that copying it costs
+        // about as much as copying the snapshot every so often.
+        if (recent->size() > threshold) {
+            if (snapshot == current->snapshot)
+                snapshot = new table_type(*snapshot);
+            snapshot->insert(recent->begin(), recent->end());
+            publish_(snapshot, empty_like_(*recent));
+        } else {
+            publish_(snapshot, recent.release());
+        }
+    }
+
+    void publish_(table_type* snapshot, table_type* recent)
+    {
+        version* old = version_.load();
+        version_.store(new version{snapshot, recent});
+
+        if (snapshot != old->snapshot) epoch_.retire(old->snapshot);
+        if (recent != old->recent) epoch_.retire(old->recent);
+        epoch_.retire(old);
+    }
+
+    std::atomic<version*> version_;
+    mutable detail::epoch_domain epoch_;
+    std::mutex writer_mutex_;
+};
+
+} // end namespace weak
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <initializer_list>
+
+namespace weak {
+
+/// A snapshot of what a table has been doing, as returned by
+/// `weak_hash_table_base::stats()`.
+///
+/// These are totals over the life of the table (or since
+/// `reset_stats()`), for tuning its maximum load factor and how often to
+/// sweep it.
+struct table_stats
+{
+    /// The longest probe that the histograms tell apart.
+    static constexpr size_t max_probe_length = 16;
+
+    /// Counts of operations indexed by how many buckets past the home
+    /// bucket they probed. The last entry counts all the longer ones too.
+    using histogram = std::array<size_t, max_probe_length + 1>;
+
+    /// Probe lengths of lookups, including those made by `find`, `erase`
+    /// and `with`. During an incremental rehash, a lookup that misses the
+    /// new buckets counts again for the old ones.
+    histogram lookup_probes {};
+    /// Probe lengths of insertions, whether or not the key was already
+    /// present, but not of elements that resizing moves.
+    histogram insert_probes {};
+
+    /// Weak pointers locked by the table itself. Iterators lock too, but
+    /// they aren't counted.
+    size_t locks = 0;
+    /// Expired elements that lookups and insertions ran into.
+    size_t expired_probed = 0;
+    /// Elements displaced from their buckets by Robin Hood insertion.
+    size_t steals = 0;
+    /// Elements shifted back by erasures.
+    size_t shifts = 0;
+
+    /// Resizes, including the start of each incremental rehash.
+    size_t resizes = 0;
+    /// Time spent in resizes. An incremental rehash only counts the time
+    /// to start it, not the migration spread over later operations.
+    std::chrono::nanoseconds resize_time {0};
+
+    /// Passes of `remove_expired()`, including those ahead of growing, and
+    /// calls to `sweep_some()`.
+    size_t sweeps = 0;
+    /// Expired elements that those sweeps removed.
+    size_t reclaimed = 0;
+
+    /// Adds another snapshot's counts to this one's.
+    table_stats& operator+=(const table_stats& other)
+    {
+        for (size_t i = 0; i <= max_probe_length; ++i) {
+            lookup_probes[i] += other.lookup_probes[i];
+            insert_probes[i] += other.insert_probes[i];
+        }
+
+        locks += other.locks;
+        expired_probed += other.expired_probed;
+        steals += other.steals;
+        shifts += other.shifts;
+        resizes += other.resizes;
+        resize_time += other.resize_time;
+        sweeps += other.sweeps;
+        reclaimed += other.reclaimed;
+        return *this;
+    }
+};
+
+/// A table stats policy that keeps nothing.
+///
+/// Every hook is empty and inline, so instrumented code compiles away, and
+/// `stats()` always returns zeros. This is the default.
+struct no_table_stats
+{
+    /// Whether anything is counted, so that tables can skip work, such as
+    /// reading the clock, that only feeds the counts.
+    static constexpr bool enabled = false;
+
+    void lookup_probed(size_t) const noexcept { }
+    void insert_probed(size_t) const noexcept { }
+    void locked() const noexcept { }
+    void probed_expired() const noexcept { }
+    void stole() const noexcept { }
+    void shifted() const noexcept { }
+    void resized(std::chrono::nanoseconds) const noexcept { }
+    void swept(size_t) const noexcept { }
+
+    void merge(const table_stats&) noexcept { }
+    table_stats snapshot() const noexcept { return {}; }
+    void reset() noexcept { }
+};
+
+/// A table stats policy that counts everything in `table_stats`.
+///
+/// Const operations record counts too, and may run on several threads at
+/// once, so the counters are relaxed atomics. That makes each hook an
+/// atomic increment, which is cheap next to the `lock()` calls it is
+/// counting, but not free, so turn this on for the tables you're tuning.
+class counting_table_stats
+{
+public:
+    static constexpr bool enabled = true;
+
+    void lookup_probed(size_t distance) const noexcept
+    {
+        bump_(lookup_probes_[bin_(distance)]);
+    }
+
+    void insert_probed(size_t distance) const noexcept
+    {
+        bump_(insert_probes_[bin_(distance)]);
+    }
+
+    void locked() const noexcept { bump_(locks_); }
+    void probed_expired() const noexcept { bump_(expired_probed_); }
+    void stole() const noexcept { bump_(steals_); }
+    void shifted() const noexcept { bump_(shifts_); }
+
+    void resized(std::chrono::nanoseconds duration) const noexcept
+    {
+        bump_(resizes_);
+        bump_(resize_nanoseconds_, size_t(duration.count()));
+    }
+
+    void swept(size_t reclaimed) const noexcept
+    {
+        bump_(sweeps_);
+        bump_(reclaimed_, reclaimed);
+    }
+
+    /// Adds the counts from `other`, such as those of a table whose
+    /// buckets this one has taken over.
+    void merge(const table_stats& other) noexcept
+    {
+        for (size_t i = 0; i <= max_probe_length_; ++i) {
+            bump_(lookup_probes_[i], other.lookup_probes[i]);
+            bump_(insert_probes_[i], other.insert_probes[i]);
+        }
+
+        bump_(locks_, other.locks);
+        bump_(expired_probed_, other.expired_probed);
+        bump_(steals_, other.steals);
+        bump_(shifts_, other.shifts);
+        bump_(resizes_, other.resizes);
+        bump_(resize_nanoseconds_, size_t(other.resize_time.count()));
+        bump_(sweeps_, other.sweeps);
+        bump_(reclaimed_, other.reclaimed);
+    }
+
+    table_stats snapshot() const noexcept
+    {
+        table_stats result;
+
+        for (size_t i = 0; i <= max_probe_length_; ++i) {
+            result.lookup_probes[i] = read_(lookup_probes_[i]);
+            result.insert_probes[i] = read_(insert_probes_[i]);
+        }
+
+        result.locks = read_(locks_);
+        result.expired_probed = read_(expired_probed_);
+        result.steals = read_(steals_);
+        result.shifts = read_(shifts_);
+        result.resizes = read_(resizes_);
+        result.resize_time = std::chrono::nanoseconds(
+                read_(resize_nanoseconds_));
+        result.sweeps = read_(sweeps_);
+        result.reclaimed = read_(reclaimed_);
+        return result;
+    }
+
+    void reset() noexcept
+    {
+        for (size_t i = 0; i <= max_probe_length_; ++i) {
+            lookup_probes_[i].store(0, std::memory_order_relaxed);
+            insert_probes_[i].store(0, std::memory_order_relaxed);
+        }
+
+        for (auto* counter : {&locks_, &expired_probed_, &steals_, &shifts_,
+                              &resizes_, &resize_nanoseconds_, &sweeps_,
+                              &reclaimed_})
+            counter->store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t max_probe_length_ = table_stats::max_probe_length;
+
+    using counter_t_ = std::atomic<size_t>;
+    using histogram_t_ = std::array<counter_t_, max_probe_length_ + 1>;
+
+    static size_t bin_(size_t distance) noexcept
+    {
+        return distance < max_probe_length_? distance : max_probe_length_;
+    }
+
+    static void bump_(counter_t_& counter, size_t amount = 1) noexcept
+    {
+        counter.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    static size_t read_(const counter_t_& counter) noexcept
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    mutable histogram_t_ lookup_probes_ {};
+    mutable histogram_t_ insert_probes_ {};
+    mutable counter_t_ locks_ {0};
+    mutable counter_t_ expired_probed_ {0};
+    mutable counter_t_ steals_ {0};
+    mutable counter_t_ shifts_ {0};
+    mutable counter_t_ resizes_ {0};
+    mutable counter_t_ resize_nanoseconds_ {0};
+    mutable counter_t_ sweeps_ {0};
+    mutable counter_t_ reclaimed_ {0};
+};
+
+} // end namespace weak
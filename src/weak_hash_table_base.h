@@ -1,15 +1,29 @@
 #pragma once
 
+#include "detail/cache_line.h"
+#include "detail/expiry_log.h"
+#include "detail/parallel_for.h"
+#include "detail/prefetch.h"
 #include "detail/raw_vector.h"
+#include "detail/view_cache.h"
+#include "detail/visit.h"
+#include "table_stats.h"
+#include "weak_table_policy.h"
 #include "weak_traits.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <climits>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace weak {
 
@@ -66,11 +80,16 @@ namespace weak {
 /// map, whereas using `weak_ptr<T>` results in a weak set. Usually this
 /// should be instantiated through one of the derived classes, and this class
 /// should not be used directly.
+///
+/// The `Policy` bundles further compile-time choices; see
+/// `default_table_policy`. For example, `power_of_two_policy` keeps
+/// power-of-two bucket counts so that probing masks rather than divides.
 template <
         class T,
         class Hash = std::hash<typename weak_traits<T>::key_type>,
         class KeyEqual = std::equal_to<>,
-        class Allocator = std::allocator<T>
+        class Allocator = std::allocator<T>,
+        class Policy = default_table_policy
 >
 class weak_hash_table_base
 {
@@ -90,6 +109,7 @@ public:
     using hasher                = Hash;
     using key_equal             = KeyEqual;
     using allocator_type        = Allocator;
+    using policy_type           = Policy;
 
     /// The default number of buckets to allocate in a new hash table.
     static constexpr size_t default_bucket_count = 8;
@@ -97,15 +117,38 @@ public:
     /// The default maximum load factor that determines when to grow.
     static constexpr float default_max_load_factor = 0.8;
 
+    /// The default minimum load factor that determines when to shrink.
+    static constexpr float default_min_load_factor = 0.1;
+
 private:
-    // We're going to steal a bit from the hash codes to store a used bit..
-    // So the number of hash bits is one less than the number of bits in size_t.
+    using indexing = typename policy_type::indexing;
+    using stats_type = typename policy_type::stats;
+    using growth = typename policy_type::growth;
+
+    // Each bucket caches its probe distance in a byte, which saturates for
+    // buckets further than that from home; then we recompute it.
+    static constexpr size_t number_of_distance_bits_ = 8;
+
+    static constexpr size_t saturated_distance_ =
+            (size_t(1) << number_of_distance_bits_) - 1;
+
+    // We're going to steal a bit from the hash codes to store a used bit,
+    // along with the distance bits. So the number of hash bits is that many
+    // fewer than the number of bits in size_t.
     static constexpr size_t number_of_hash_bits_ =
-            sizeof(size_t) * CHAR_BIT - 1;
+            sizeof(size_t) * CHAR_BIT - 1 - number_of_distance_bits_;
 
     static constexpr size_t hash_code_mask_ =
             (size_t(1) << number_of_hash_bits_) - 1;
 
+    // How many elements a bulk insert or lookup hashes and prefetches
+    // ahead of probing for them.
+    static constexpr size_t batch_size_ = 16;
+
+    // A parallel resize gives each thread at least this many old buckets,
+    // since below that starting threads costs more than it saves.
+    static constexpr size_t min_buckets_per_resize_task_ = 1 << 14;
+
 protected:
     /// A bucket, which contains the stored `weak_value_type` along with
     /// some hidden metadata.
@@ -133,15 +176,13 @@ protected:
     private:
         weak_value_type value_;
         size_t          used_      : 1,
+                        distance_  : number_of_distance_bits_,
                         hash_code_ : number_of_hash_bits_;
         // INVARIANT:
-        //   - if used_ then value_ and hash_code_ are initialized, otherwise
-        //     not
-
-        bool occupied_() const
-        {
-            return used_ && !value_.expired();
-        }
+        //   - if used_ then value_, distance_ and hash_code_ are
+        //     initialized, otherwise not
+        //   - distance_ is the bucket's distance from its home bucket, or
+        //     saturated_distance_ if it's at least that far
 
         friend class weak_hash_table_base;
     };
@@ -175,8 +216,15 @@ public:
             , bucket_allocator_(allocator)
             , weak_value_allocator_(allocator)
             , max_load_factor_(default_max_load_factor)
-            , buckets_(bucket_count, bucket_allocator_)
+            , min_load_factor_(default_min_load_factor)
+            , buckets_(indexing::bucket_count(bucket_count), bucket_allocator_)
             , size_(0)
+            , sweep_cursor_(0)
+            , swept_since_resize_(0)
+            , reserved_bucket_count_(bucket_count)
+            , rehash_step_(0)
+            , resize_threads_(1)
+            , migrate_cursor_(0)
     {
         init_buckets_();
     }
@@ -253,15 +301,24 @@ public:
     { }
 
     /// Copy constructor with allocator.
+    ///
+    /// This takes the same number of buckets as `other` so that it can copy
+    /// them one for one, unless `other` is midway through an incremental
+    /// rehash.
     weak_hash_table_base(const weak_hash_table_base& other,
                          const allocator_type& allocator)
-            : weak_hash_table_base(other.min_bucket_count_(),
+            : weak_hash_table_base(other.old_? other.min_bucket_count_()
+                                             : other.bucket_count(),
                                    other.hasher_,
                                    other.equal_,
                                    allocator)
     {
         max_load_factor(other.max_load_factor());
-        insert(other.begin(), other.end());
+        min_load_factor(other.min_load_factor());
+        reserved_bucket_count_ = other.reserved_bucket_count_;
+        rehash_step(other.rehash_step());
+        resize_threads(other.resize_threads());
+        copy_from_(other);
     }
 
     /// Move constructor.
@@ -314,14 +371,20 @@ public:
     /// Destructor.
     ~weak_hash_table_base()
     {
+        if (expiry_log_) expiry_log_->detach();
         clear();
     }
 
     /// Copy-assignment.
     weak_hash_table_base& operator=(const weak_hash_table_base& other)
     {
-        clear();
-        insert(other.begin(), other.end());
+        if (this != &other) {
+            clear();
+            hasher_ = other.hasher_;
+            equal_ = other.equal_;
+            copy_from_(other);
+        }
+
         return *this;
     }
 
@@ -355,7 +418,7 @@ public:
     /// non-empty.
     bool empty() const
     {
-        return size_ == 0;
+        return size() == 0;
     }
 
     /// The number of open-addressed buckets.
@@ -370,7 +433,7 @@ public:
     float load_factor() const
     {
         if (bucket_count() == 0) return 1;
-        return float(size_) / bucket_count();
+        return float(size()) / bucket_count();
     }
 
     /// The maximum load factor, exceeding which will trigger growth.
@@ -388,12 +451,105 @@ public:
         max_load_factor_ = new_value;
     }
 
+    /// The minimum load factor, falling below which when elements are
+    /// removed will trigger shrinking.
+    ///
+    /// This defaults to `default_min_load_factor`, so a table whose
+    /// elements mostly expire gives back its buckets on the next erase,
+    /// `remove_expired()` or `sweep_some()`, paying for a rehash to do so.
+    /// Set it to 0 to keep the buckets instead.
+    float min_load_factor() const
+    {
+        return min_load_factor_;
+    }
+
+    /// Sets the minimum load factor. Setting it to 0 disables automatic
+    /// shrinking.
+    ///
+    /// A table that shrinks is rehashed to half its maximum load factor,
+    /// so it won't grow or shrink again right away. It never shrinks on its
+    /// own below the bucket count asked for through the constructor or
+    /// `reserve()`, so a table sized up front stays that size while it
+    /// fills; only `shrink_to_fit()` goes lower.
+    ///
+    /// *PRECONDITION*: 0 <= `new_value` < `max_load_factor() / 2`
+    void min_load_factor(float new_value)
+    {
+        assert(0 <= new_value && new_value < max_load_factor() / 2);
+        min_load_factor_ = new_value;
+    }
+
+    /// The number of old buckets migrated per operation while rehashing
+    /// incrementally, or 0 if the table rehashes all at once.
+    size_t rehash_step() const
+    {
+        return rehash_step_;
+    }
+
+    /// Sets the incremental rehashing step, which is 0 by default.
+    ///
+    /// When it's positive, growing allocates the new buckets but leaves
+    /// the elements where they are, and then each insert, erase, and
+    /// non-const `find` migrates up to `new_value` of the old buckets.
+    /// Until they're all done, lookups consult both bucket arrays. This
+    /// trades a little per-operation overhead for not stopping the world
+    /// to rehash a large table.
+    ///
+    /// Setting it to 0 finishes any migration in progress.
+    void rehash_step(size_t new_value)
+    {
+        rehash_step_ = new_value;
+        if (new_value == 0) finish_rehash_();
+    }
+
+    /// The number of threads that rehashing all at once runs on.
+    size_t resize_threads() const
+    {
+        return resize_threads_;
+    }
+
+    /// Sets the number of threads that rehashing all at once runs on, the
+    /// calling one included, which is 1 by default.
+    ///
+    /// Above 1, a resize of a large table splits the new buckets into
+    /// ranges and has each thread place the elements that belong in one.
+    /// Small tables still resize on the calling thread. As with the
+    /// parallel `remove_expired`, the weak pointers must be safe to release
+    /// on any thread.
+    ///
+    /// *PRECONDITION*: `new_value > 0`
+    void resize_threads(size_t new_value)
+    {
+        assert(new_value > 0);
+        resize_threads_ = new_value;
+    }
+
+    /// What the table has counted since it was constructed, or since
+    /// `reset_stats()`, if the policy's `stats` is `counting_table_stats`.
+    /// (By default, this is all zeros.)
+    ///
+    /// Copies start counting from zero, while moving or swapping tables
+    /// takes the counts along with the elements.
+    table_stats stats() const
+    {
+        table_stats result = stats_.snapshot();
+        if (old_) result += old_->stats_.snapshot();
+        return result;
+    }
+
+    /// Sets all of `stats()` back to zero.
+    void reset_stats()
+    {
+        stats_.reset();
+        if (old_) old_->stats_.reset();
+    }
+
     /// Note that because pointers may expire without the table finding
     /// out, size() is generally an overapproximation of the number of
     /// elements in the hash table.
     size_t size() const
     {
-        return size_;
+        return old_? size_ + old_->size_ : size_;
     }
 
     /// Removes all elements.
@@ -406,24 +562,104 @@ public:
         }
 
         size_ = 0;
+        if (old_) drop_old_();
+        if (expiry_log_) expiry_log_->take();
     }
 
     /// Cleans up expired elements. After this, `size()` is accurate.
+    ///
+    /// This may shrink the table; see `min_load_factor()`.
     void remove_expired()
     {
-        for (size_t i = 0; i < bucket_count(); ++i) {
-            Bucket& bucket = buckets_[i];
+        remove_expired_();
+        maybe_shrink_();
+    }
+
+    /// Cleans up expired elements like `remove_expired()`, sweeping on
+    /// `threads` threads, the calling one included.
+    ///
+    /// A sweep spends most of its time missing cache on the weak pointers'
+    /// control blocks, which threads can wait on side by side. The weak
+    /// pointers must be safe to release on any thread, so this isn't for
+    /// tables of `local_weak_ptr`s.
+    void remove_expired(size_t threads)
+    {
+        remove_expired(threads, detail::thread_per_task{});
+    }
+
+    /// Cleans up expired elements like `remove_expired()`, splitting the
+    /// buckets into `tasks` chunks for the given executor to sweep.
+    ///
+    /// `parallel_for(tasks, sweep)` must call `sweep(i)` once for each `i`
+    /// in `[0, tasks)`, on whatever threads it likes, and return once
+    /// they've all returned. Chunks start at empty buckets, so erasing in
+    /// one never shifts elements into another.
+    template <class ParallelFor>
+    void remove_expired(size_t tasks, ParallelFor&& parallel_for)
+    {
+        if (expiry_log_) expiry_log_->take();
+        size_t old_size = size();
+        remove_expired_parallel_(std::max(tasks, size_t(1)), parallel_for);
+        record_sweep_(old_size);
+        maybe_shrink_();
+    }
+
+    /// Cleans up expired elements in at most `max_buckets` buckets,
+    /// continuing from where the previous call left off and wrapping around
+    /// at the end. Returns the number of elements removed.
+    ///
+    /// Calling this regularly, such as after each operation or when idle,
+    /// spreads the work of `remove_expired()` out into bounded steps. Once
+    /// it has covered the whole table, growing no longer needs a full
+    /// sweep first. (Like `remove_expired()`, though, it may shrink the
+    /// table.)
+    size_t sweep_some(size_t max_buckets)
+    {
+        size_t old_size = size_;
+        size_t count = std::min(max_buckets, bucket_count());
+
+        for (size_t i = 0; i < count; ) {
+            if (sweep_cursor_ >= bucket_count()) sweep_cursor_ = 0;
+            Bucket& bucket = buckets_[sweep_cursor_];
+            // Erasing shifts the next element back into this bucket, so
+            // we stay put and check it again.
             if (bucket.used_ && bucket.value_.expired()) {
-                erase_index_(i);
+                erase_index_(sweep_cursor_);
+            } else {
+                ++sweep_cursor_;
+                ++i;
             }
         }
+
+        swept_since_resize_ += count;
+        size_t removed = old_size - size_;
+        stats_.swept(removed);
+        maybe_shrink_();
+        return removed;
+    }
+
+    /// Removes expired elements and then shrinks the table to the fewest
+    /// buckets that keep it within the maximum load factor.
+    ///
+    /// This also forgets the bucket counts asked for earlier, so that
+    /// automatic shrinking may go below them (see `min_load_factor()`).
+    void shrink_to_fit()
+    {
+        remove_expired_();
+        reserved_bucket_count_ = 0;
+        resize_(min_bucket_count_());
     }
 
     /// Reserves room for `extra` additional elements, sort of.
+    ///
+    /// The table won't shrink on its own below the resulting bucket count.
     void reserve(size_t extra)
     {
-        remove_expired();
-        resize_(std::max(size() + extra, min_bucket_count_()));
+        sweep_before_resize_();
+        size_t new_bucket_count = std::max(size() + extra, min_bucket_count_());
+        reserved_bucket_count_ =
+                std::max(reserved_bucket_count_, new_bucket_count);
+        resize_(new_bucket_count);
     }
 
     /// Inserts an element.
@@ -441,33 +677,61 @@ public:
     }
 
     /// Inserts a range of elements.
+    ///
+    /// This hashes each batch of elements and prefetches their home
+    /// buckets before inserting any of them. Given forward iterators, it
+    /// makes room for the whole range at once, so that the table grows (and
+    /// sweeps out expired elements) at most once.
     template <typename InputIter>
     void insert(InputIter start, InputIter limit)
     {
-        for ( ; start != limit; ++start)
-            insert(*start);
+        using category =
+                typename std::iterator_traits<InputIter>::iterator_category;
+
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>)
+            reserve_for_insert_(size_t(std::distance(start, limit)));
+
+        insert_batched_(start, limit);
+    }
+
+    /// Inserts an element constructed from the given arguments.
+    ///
+    /// The strong value is built once and then moved into its bucket, so
+    /// passing rvalue pointers costs no extra reference counting.
+    template <class... Args>
+    void emplace(Args&&... args)
+    {
+        insert(strong_value_type(std::forward<Args>(args)...));
     }
 
 private:
-    bool destroy_range_(size_t start, size_t limit)
+    /// Destroys the buckets in `[start, limit)`, returning how many.
+    size_t destroy_range_(size_t start, size_t limit)
     {
+        size_t count = 0;
+
         for ( ; start != limit; start = next_bucket_(start)) {
             destroy_bucket_(buckets_[start]);
-            --size_;
+            ++count;
         }
-    }
 
-    static bool in_interval_(size_t start, size_t value, size_t limit)
-    {
-        if (start <= limit)
-            return start <= value && value < limit;
-        else
-            return start <= value || value < limit;
+        return count;
     }
 
     /// Removes the bucket at index, shifting if necessary.
     void erase_index_(size_t index)
     {
+        size_ -= erase_in_run_(index);
+    }
+
+    /// Removes the bucket at index, shifting the rest of its run back if
+    /// necessary (and dropping any expired elements it passes), and
+    /// returns how many elements that removed. This touches only the
+    /// buckets from `index` to the end of its run, and leaves `size_` to
+    /// the caller, so different runs can be erased from at once.
+    size_t erase_in_run_(size_t index)
+    {
+        size_t removed = 0;
         size_t dst = index;
         size_t src = next_bucket_(dst);
 
@@ -477,17 +741,23 @@ private:
             Bucket& bucket = buckets_[src];
             if (!bucket.used_) break;
 
-            size_t goal_pos = which_bucket_(bucket.hash_code_);
-            size_t dist = probe_distance_(src, goal_pos);
+            size_t dist = bucket_distance_(src, bucket);
             if (dist == 0) break;
 
             if (!bucket.value_.expired()) {
-                if (in_interval_(dst, goal_pos, src)) {
-                    destroy_range_(dst, goal_pos);
+                // Shifting back by `gap` would take it home, or past.
+                size_t gap = probe_distance_(src, dst);
+                if (dist <= gap) {
+                    size_t goal_pos = which_bucket_(bucket.hash_code_);
+                    removed += destroy_range_(dst, goal_pos);
                     buckets_[goal_pos] = std::move(bucket);
+                    set_distance_(buckets_[goal_pos], 0);
+                    stats_.shifted();
                     dst = next_bucket_(goal_pos);
                 } else {
                     buckets_[dst] = std::move(bucket);
+                    set_distance_(buckets_[dst], dist - gap);
+                    stats_.shifted();
                     dst = next_bucket_(dst);
                 }
             }
@@ -495,20 +765,32 @@ private:
             src = next_bucket_(src);
         }
 
-        destroy_range_(dst, src);
+        return removed + destroy_range_(dst, src);
     }
 
 public:
     /// Erases the element if the given key, returning whether an
     /// element was actually erased.
-    bool erase(const key_type& key)
+    ///
+    /// Like `find`, this takes anything that the hasher and key equality
+    /// accept, so a transparent hasher can avoid building a `key_type`.
+    template <class KeyLike = key_type>
+    bool erase(const KeyLike& key)
     {
-        if (auto bucket_index = lookup_(key)) {
+        remove_tracked_expired_();
+        migrate_some_();
+
+        size_t hash_code = hash_(key);
+        if (auto bucket_index = lookup_(hash_code, key)) {
             erase_index_(*bucket_index);
-            return true;
+        } else if (auto old_index = lookup_old_(hash_code, key)) {
+            old_->erase_index_(*old_index);
         } else {
             return false;
         }
+
+        maybe_shrink_();
+        return true;
     }
 
     /// Swaps this weak hash table with another in constant time.
@@ -517,18 +799,61 @@ public:
         using std::swap;
         swap(buckets_, other.buckets_);
         swap(size_, other.size_);
+        swap(sweep_cursor_, other.sweep_cursor_);
+        swap(swept_since_resize_, other.swept_since_resize_);
+        swap(reserved_bucket_count_, other.reserved_bucket_count_);
         swap(hasher_, other.hasher_);
         swap(equal_, other.equal_);
         swap(bucket_allocator_, other.bucket_allocator_);
         swap(weak_value_allocator_, other.weak_value_allocator_);
         swap(max_load_factor_, other.max_load_factor_);
+        swap(min_load_factor_, other.min_load_factor_);
+        swap(rehash_step_, other.rehash_step_);
+        swap(resize_threads_, other.resize_threads_);
+        swap(old_, other.old_);
+        swap(migrate_cursor_, other.migrate_cursor_);
+        swap(expiry_log_, other.expiry_log_);
+        swap(last_sweep_, other.last_sweep_);
+
+        if constexpr (stats_type::enabled) {
+            table_stats ours = stats_.snapshot();
+            stats_.reset();
+            stats_.merge(other.stats_.snapshot());
+            other.stats_.reset();
+            other.stats_.merge(ours);
+        }
+    }
+
+    /// Constructs a `U` from `args`, returning a pointer that tells this
+    /// table when it expires.
+    ///
+    /// Storing the result in the table (as the key, for a map) lets the
+    /// next insert or erase remove the element as soon as it expires,
+    /// without waiting for a sweep to come across it. In a
+    /// `weak_key_unordered_map`, this frees the mapped value promptly too.
+    /// Untracked elements are still removed only by sweeping.
+    ///
+    /// The hasher must accept a `U`, and the object is allocated separately
+    /// from its control block, unlike with `std::make_shared`.
+    template <class U, class... Args>
+    std::shared_ptr<U> make_tracked(Args&&... args)
+    {
+        if (!expiry_log_)
+            expiry_log_ = std::make_shared<detail::expiry_log>();
+
+        auto object = std::make_unique<U>(std::forward<Args>(args)...);
+        size_t hash_code = hash_(std::as_const(*object));
+        return std::shared_ptr<U>(
+                object.release(),
+                detail::tracked_deleter<U>{expiry_log_, hash_code});
     }
 
     /// Is the given key mapped by this hash table?
     template <class KeyLike>
     bool member(const KeyLike& key) const
     {
-        return lookup_(key) != std::nullopt;
+        size_t hash_code = hash_(key);
+        return lookup_(hash_code, key) || lookup_old_(hash_code, key);
     }
 
     /// Counts the number of times the `key` appears (0 or 1).
@@ -545,14 +870,109 @@ public:
     template <class KeyLike>
     iterator find(const KeyLike& key)
     {
-        return make_iterator_(lookup_(key));
+        migrate_some_();
+        return find_hashed_(hash_(key), key);
     }
 
     /// Returns an iterator to the given key, or `this->end()` if not found.
+    ///
+    /// Unlike the non-const overload, this never migrates buckets.
     template <class KeyLike>
     const_iterator find(const KeyLike& key) const
     {
-        return make_iterator_(lookup_(key));
+        return find_hashed_(hash_(key), key);
+    }
+
+    /// Looks up each key in the range `[first, last)`, writing an iterator
+    /// to it, or `this->end()` if not found, to `out`. Returns `out` past
+    /// the last iterator written.
+    ///
+    /// Rather than finishing each lookup before starting the next, this
+    /// hashes a batch of keys and prefetches their home buckets before
+    /// probing for any of them, so that their cache misses overlap.
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out)
+    {
+        migrate_some_();
+
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = find_hashed_(hash_code, key);
+                             });
+        return out;
+    }
+
+    /// Looks up each key in the range `[first, last)`, writing an iterator
+    /// to it, or `this->end()` if not found, to `out`. Returns `out` past
+    /// the last iterator written.
+    ///
+    /// Unlike the non-const overload, this never migrates buckets.
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = find_hashed_(hash_code, key);
+                             });
+        return out;
+    }
+
+    /// Writes whether each key in the range `[first, last)` is mapped by
+    /// this hash table to `out`, batching the lookups like `find_many`.
+    /// Returns `out` past the last result written.
+    template <class ForwardIt, class OutputIt>
+    OutputIt member_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = bool(lookup_(hash_code, key) ||
+                                               lookup_old_(hash_code, key));
+                             });
+        return out;
+    }
+
+    /// Calls `fn` on a view of the element whose key is `key`, if there is
+    /// one, and returns whether there was.
+    ///
+    /// This locks the element once, both to compare its key and to lend it
+    /// to `fn`, whereas `find` and then dereferencing locks it twice.
+    template <class KeyLike = key_type, class Fn>
+    bool with(const KeyLike& key, Fn&& fn)
+    {
+        migrate_some_();
+        return with_hashed_(*this, hash_(key), key, fn);
+    }
+
+    /// Calls `fn` on a const view of the element whose key is `key`, if
+    /// there is one, and returns whether there was.
+    ///
+    /// Unlike the non-const overload, this never migrates buckets.
+    template <class KeyLike = key_type, class Fn>
+    bool with(const KeyLike& key, Fn&& fn) const
+    {
+        return with_hashed_(*this, hash_(key), key, fn);
+    }
+
+    /// Calls `fn` on a view of each live element, locking each element
+    /// once.
+    ///
+    /// If `fn` returns a value, returning `false` stops the visit early.
+    /// Returns whether every live element was visited.
+    template <class Fn>
+    bool for_each_live(Fn&& fn)
+    {
+        return for_each_live_(*this, fn);
+    }
+
+    /// Calls `fn` on a const view of each live element, locking each
+    /// element once.
+    ///
+    /// If `fn` returns a value, returning `false` stops the visit early.
+    /// Returns whether every live element was visited.
+    template <class Fn>
+    bool for_each_live(Fn&& fn) const
+    {
+        return for_each_live_(*this, fn);
     }
 
     /// Returns an iterator to the beginning of the hash table.
@@ -592,16 +1012,43 @@ public:
     }
 
 private:
+    // Iterators visit this table's buckets and then, while migrating, the
+    // old table's, so they end at the end of whichever comes last.
+
     iterator make_iterator_(std::optional<size_t> bucket_index)
     {
-        return {bucket_index? &buckets_[*bucket_index] : buckets_.end(),
-                buckets_.end()};
+        if (!bucket_index) {
+            auto limit = old_? old_->buckets_.end() : buckets_.end();
+            return iterator(limit);
+        } else if (old_) {
+            return {&buckets_[*bucket_index], buckets_.end(),
+                    old_->buckets_.begin(), old_->buckets_.end()};
+        } else {
+            return {&buckets_[*bucket_index], buckets_.end(), {}, {}};
+        }
     }
 
     const_iterator make_iterator_(std::optional<size_t> bucket_index) const
     {
-        return {bucket_index? &buckets_[*bucket_index] : buckets_.end(),
-                buckets_.end()};
+        if (!bucket_index) {
+            auto limit = old_? old_->buckets_.end() : buckets_.end();
+            return const_iterator(limit);
+        } else if (old_) {
+            return {&buckets_[*bucket_index], buckets_.end(),
+                    old_->buckets_.begin(), old_->buckets_.end()};
+        } else {
+            return {&buckets_[*bucket_index], buckets_.end(), {}, {}};
+        }
+    }
+
+    iterator make_old_iterator_(size_t old_index)
+    {
+        return {&old_->buckets_[old_index], old_->buckets_.end(), {}, {}};
+    }
+
+    const_iterator make_old_iterator_(size_t old_index) const
+    {
+        return {&old_->buckets_[old_index], old_->buckets_.end(), {}, {}};
     }
 
 private:
@@ -610,22 +1057,302 @@ private:
     bucket_allocator_type bucket_allocator_;
     weak_value_allocator_type weak_value_allocator_;
     float max_load_factor_;
+    float min_load_factor_;
 
     vector_t buckets_;
     size_t size_;
+    // Where `sweep_some` resumes, and how many buckets it has visited since
+    // the table was last resized.
+    size_t sweep_cursor_;
+    size_t swept_since_resize_;
+    // The most buckets asked for through the constructor or `reserve()`,
+    // which automatic shrinking stays at or above.
+    size_t reserved_bucket_count_;
+    size_t rehash_step_;
+    // How many threads a resize may use.
+    size_t resize_threads_;
+    // While rehashing incrementally, the table whose buckets are still
+    // being migrated, and where migration resumes.
+    //
+    // INVARIANT: if old_ then old_->buckets_[i] is unused for all
+    // i < migrate_cursor_, and old_->old_ is null
+    std::unique_ptr<weak_hash_table_base> old_;
+    size_t migrate_cursor_;
+    // Where tracked elements report expiring; null until `make_tracked` is
+    // first called.
+    std::shared_ptr<detail::expiry_log> expiry_log_;
+    // Counts for `stats()`, which compile away under `no_table_stats`.
+    stats_type stats_;
+    // For the growth policy to decide whether to sweep before growing.
+    sweep_history last_sweep_;
+
+    /// Whether the load factor exceeds `target` times the maximum, or there
+    /// are no free buckets.
+    bool needs_to_grow_(float target = 1)
+    {
+        return load_factor() > target * max_load_factor() ||
+               size() >= bucket_count();
+    }
+
+    /// Removes expired elements ahead of a resize, unless `sweep_some` has
+    /// already been all the way around since the last one, in which case
+    /// we don't stall for another pass.
+    void sweep_before_resize_()
+    {
+        if (swept_since_resize_ < bucket_count())
+            remove_expired_();
+    }
+
+    void remove_expired_()
+    {
+        // This finds any tracked elements that have expired too.
+        if (expiry_log_) expiry_log_->take();
+
+        size_t old_size = size();
+        erase_expired_buckets_();
+        if (old_) old_->erase_expired_buckets_();
+        record_sweep_(old_size);
+    }
+
+    /// Notes a full sweep that started with `old_size` elements.
+    void record_sweep_(size_t old_size)
+    {
+        last_sweep_ = {old_size, old_size - size(), 0};
+        stats_.swept(last_sweep_.reclaimed);
+    }
+
+    void erase_expired_buckets_()
+    {
+        for (size_t i = 0; i < bucket_count(); ++i) {
+            Bucket& bucket = buckets_[i];
+            if (bucket.used_ && bucket.value_.expired()) {
+                erase_index_(i);
+            }
+        }
+    }
+
+    template <class ParallelFor>
+    void remove_expired_parallel_(size_t tasks, ParallelFor& parallel_for)
+    {
+        size_t n = bucket_count();
+
+        // Positions run from the first empty bucket for one lap of the
+        // table, so the run that wraps around the end stays in one chunk.
+        size_t first_empty = 0;
+        while (first_empty < n && buckets_[first_empty].used_)
+            ++first_empty;
+
+        std::vector<size_t> bounds(tasks + 1, first_empty + n);
+        if (first_empty == n) {
+            // No empty bucket means no runs to split at.
+            tasks = 1;
+            bounds = {0, n};
+        } else {
+            bounds[0] = first_empty;
+            for (size_t t = 1; t < tasks; ++t) {
+                size_t pos = std::max(first_empty + t * n / tasks,
+                                      bounds[t - 1]);
+                while (pos < first_empty + n && buckets_[pos % n].used_)
+                    ++pos;
+                bounds[t] = pos;
+            }
+        }
 
-    bool needs_to_grow_()
+        std::vector<size_t> removed(tasks, 0);
+        auto sweep = [&](size_t t) {
+            size_t count = 0;
+            for (size_t pos = bounds[t]; pos < bounds[t + 1]; ++pos) {
+                size_t i = pos < n? pos : pos - n;
+                Bucket& bucket = buckets_[i];
+                if (bucket.used_ && bucket.value_.expired())
+                    count += erase_in_run_(i);
+            }
+            removed[t] = count;
+        };
+
+        parallel_for(tasks, sweep);
+
+        for (size_t count : removed)
+            size_ -= count;
+
+        if (old_) old_->remove_expired_parallel_(tasks, parallel_for);
+    }
+
+    /// Erases the elements whose tracked pointers have reported expiring.
+    void remove_tracked_expired_()
+    {
+        if (!expiry_log_ || !expiry_log_->pending()) return;
+
+        for (size_t hash_code : expiry_log_->take()) {
+            erase_expired_(hash_code);
+            if (old_) old_->erase_expired_(hash_code);
+        }
+    }
+
+    /// Erases the expired elements with the given hash code.
+    void erase_expired_(size_t hash_code)
+    {
+        size_t pos = which_bucket_(hash_code);
+        size_t dist = 0;
+
+        for (;;) {
+            Bucket& bucket = buckets_[pos];
+
+            if (!bucket.used_ || dist > bucket_distance_(pos, bucket))
+                return;
+
+            // Erasing shifts the next element back into `pos`, so we look
+            // at `pos` again.
+            if (hash_code == bucket.hash_code_ && bucket.value_.expired()) {
+                erase_index_(pos);
+                continue;
+            }
+
+            pos = next_bucket_(pos);
+            ++dist;
+        }
+    }
+
+    /// Sweeps ahead of growing if the growth policy says to, and returns
+    /// whether it did.
+    bool sweep_before_growing_()
     {
-        return load_factor() > max_load_factor() || size() >= bucket_count();
+        if (growth::sweep_before_growing(last_sweep_)) {
+            sweep_before_resize_();
+            return true;
+        }
+
+        ++last_sweep_.skipped;
+        return false;
     }
 
+    /// Grows if we're over the maximum load factor, first sweeping if the
+    /// growth policy thinks it's worth it.
     void maybe_grow_()
     {
-        if (needs_to_grow_()) {
-            remove_expired();
-            if (needs_to_grow_())
-                resize_(std::max(2 * bucket_count(), size() + 1));
+        if (!needs_to_grow_()) return;
+
+        if (sweep_before_growing_() && !needs_to_grow_(growth::sweep_target))
+            return;
+
+        size_t new_bucket_count =
+                std::max({growth::grow(bucket_count()), size() + 1,
+                          size_t(growth::min_bucket_count)});
+        if (rehash_step_ == 0)
+            resize_(new_bucket_count);
+        else
+            begin_rehash_(new_bucket_count);
+    }
+
+    /// Shrinks to half the maximum load factor if we've fallen below the
+    /// minimum. This waits for any migration to finish, since until then
+    /// we're busy growing.
+    void maybe_shrink_()
+    {
+        if (old_ || bucket_count() <= growth::min_bucket_count ||
+                load_factor() >= min_load_factor())
+            return;
+
+        size_t new_bucket_count =
+                std::max({size_t(2 * size() / max_load_factor()) + 1,
+                          size_t(growth::min_bucket_count),
+                          reserved_bucket_count_});
+        if (indexing::bucket_count(new_bucket_count) >= bucket_count())
+            return;
+
+        if (rehash_step_ == 0)
+            resize_(new_bucket_count);
+        else
+            begin_rehash_(new_bucket_count);
+    }
+
+    /// Switches to a fresh array of buckets, keeping the current ones in
+    /// `old_` to be migrated gradually.
+    void begin_rehash_(size_t new_bucket_count)
+    {
+        finish_rehash_();
+        auto started = stats_clock_();
+
+        using std::swap;
+        vector_t new_buckets(indexing::bucket_count(new_bucket_count),
+                             bucket_allocator_);
+        old_ = std::make_unique<weak_hash_table_base>(
+                0, hasher_, equal_, get_allocator());
+        swap(old_->buckets_, buckets_);
+        swap(buckets_, new_buckets);
+        old_->size_ = size_;
+        size_ = 0;
+        migrate_cursor_ = 0;
+        sweep_cursor_ = 0;
+        swept_since_resize_ = 0;
+        init_buckets_();
+        stats_.resized(stats_clock_() - started);
+    }
+
+    void migrate_some_()
+    {
+        migrate_buckets_(rehash_step_);
+    }
+
+    void finish_rehash_()
+    {
+        migrate_buckets_(std::numeric_limits<size_t>::max());
+    }
+
+    /// Migrates up to `max_buckets` of the old buckets, and drops the old
+    /// table once it's empty.
+    void migrate_buckets_(size_t max_buckets)
+    {
+        if (!old_) return;
+
+        for (size_t i = 0;
+             i < max_buckets && migrate_cursor_ < old_->bucket_count();
+             ++i) {
+            // Erasing shifts the next element back into this bucket, so
+            // we only move on once it's unused.
+            if (old_->buckets_[migrate_cursor_].used_)
+                migrate_index_(migrate_cursor_);
+            else
+                ++migrate_cursor_;
+        }
+
+        if (old_->size_ == 0) drop_old_();
+    }
+
+    /// Drops the old table, keeping what it counted.
+    void drop_old_()
+    {
+        stats_.merge(old_->stats_.snapshot());
+        old_.reset();
+    }
+
+    /// Moves the element at `old_index` in the old buckets to the new ones,
+    /// unless it has expired.
+    void migrate_index_(size_t old_index)
+    {
+        Bucket& bucket = old_->buckets_[old_index];
+
+        // The element may expire after any check, so we lock it once and
+        // move it over only if that found it live, as `resize_` does.
+        view_value_type view = bucket.value_.lock();
+        stats_.locked();
+        const_view_value_type const_view = view;
+        if (weak_trait::key(const_view)) {
+            insert_(bucket.hash_code_, weak_trait::move(view), false);
         }
+
+        old_->erase_index_(old_index);
+    }
+
+    /// Looks up `key` among the buckets still to be migrated, if any.
+    template <class KeyLike>
+    std::optional<size_t> lookup_old_(size_t hash_code,
+                                      const KeyLike& key) const
+    {
+        if (old_)
+            return old_->lookup_(hash_code, key);
+        else
+            return std::nullopt;
     }
 
     size_t min_bucket_count_() const noexcept
@@ -635,47 +1362,225 @@ private:
 
     void resize_(size_t new_bucket_count)
     {
+        finish_rehash_();
         assert(new_bucket_count > size_);
+        auto started = stats_clock_();
+
+        size_t tasks = std::min(resize_threads_,
+                                bucket_count() / min_buckets_per_resize_task_);
+        if (tasks > 1) {
+            resize_parallel_(new_bucket_count, tasks,
+                             detail::thread_per_task{});
+            stats_.resized(stats_clock_() - started);
+            return;
+        }
 
         using std::swap;
-        vector_t old_buckets(new_bucket_count, bucket_allocator_);
+        vector_t old_buckets(indexing::bucket_count(new_bucket_count),
+                             bucket_allocator_);
         swap(old_buckets, buckets_);
         size_ = 0;
+        sweep_cursor_ = 0;
+        swept_since_resize_ = 0;
         init_buckets_();
 
         for (Bucket& bucket : old_buckets) {
             if (bucket.used_) {
                 view_value_type view = bucket.value_.lock();
+                stats_.locked();
                 const_view_value_type const_view = view;
                 if (weak_trait::key(const_view)) {
                     insert_(bucket.hash_code_, weak_trait::move(view), false);
                 }
+                destroy_bucket_(bucket);
+            }
+        }
+
+        stats_.resized(stats_clock_() - started);
+    }
+
+    /// The time now, if the stats want it for timing resizes.
+    static std::chrono::steady_clock::time_point stats_clock_()
+    {
+        if constexpr (stats_type::enabled)
+            return std::chrono::steady_clock::now();
+        else
+            return {};
+    }
+
+    /// Resizes like `resize_`, with `parallel_for` running `tasks` tasks
+    /// at a time (see the parallel `remove_expired`).
+    ///
+    /// The new buckets are split into one range per task, and each old
+    /// element goes to the task whose range holds its home bucket. Each task
+    /// places its elements by Robin Hood insertion that stops at the end of
+    /// its range; whatever would spill past the end waits in its old bucket,
+    /// and those are placed at the end, on the calling thread, where they
+    /// can cross into the next range or wrap around.
+    template <class ParallelFor>
+    void resize_parallel_(size_t new_bucket_count, size_t tasks,
+                          ParallelFor&& parallel_for)
+    {
+        // Everything that can throw comes before the first element moves.
+        vector_t old_buckets(indexing::bucket_count(new_bucket_count),
+                             bucket_allocator_);
+        // Row `t` has task `t`'s counts, or cursors, per range, and rows are
+        // padded apart so that tasks don't share cache lines.
+        size_t stride = tasks + detail::cache_line_size / sizeof(size_t);
+        std::vector<size_t> counts(tasks * stride, 0);
+        // The old indices of the elements, grouped by range.
+        std::vector<size_t> staged(size_);
+        std::vector<size_t> range_start(tasks + 1, 0);
+        std::vector<size_t> spilled_end(tasks, 0);
+        std::vector<size_t> placed(tasks, 0);
+
+        using std::swap;
+        swap(old_buckets, buckets_);
+        init_buckets_();
+        sweep_cursor_ = 0;
+        swept_since_resize_ = 0;
+
+        size_t old_count = old_buckets.size();
+        size_t new_count = bucket_count();
+        size_t range_size = (new_count + tasks - 1) / tasks;
+        auto range_of = [&](const Bucket& bucket) {
+            return which_bucket_(bucket.hash_code_) / range_size;
+        };
+        auto old_start = [&](size_t t) { return t * old_count / tasks; };
+
+        // Drop expired elements and count the rest by range.
+        auto count = [&](size_t t) {
+            size_t* row = &counts[t * stride];
+            for (size_t i = old_start(t); i < old_start(t + 1); ++i) {
+                Bucket& bucket = old_buckets[i];
+                if (!bucket.used_) continue;
+
+                if (bucket.value_.expired())
+                    destroy_bucket_(bucket);
+                else
+                    ++row[range_of(bucket)];
+            }
+        };
+        parallel_for(tasks, count);
+
+        // Turn the counts into each task's cursor into each range.
+        size_t total = 0;
+        for (size_t r = 0; r < tasks; ++r) {
+            range_start[r] = total;
+            for (size_t t = 0; t < tasks; ++t)
+                total += std::exchange(counts[t * stride + r], total);
+        }
+        range_start[tasks] = total;
+
+        auto stage = [&](size_t t) {
+            size_t* row = &counts[t * stride];
+            for (size_t i = old_start(t); i < old_start(t + 1); ++i) {
+                if (old_buckets[i].used_)
+                    staged[row[range_of(old_buckets[i])]++] = i;
+            }
+        };
+        parallel_for(tasks, stage);
+
+        // Afterward, the front of each range's staged indices lists the
+        // elements that spilled over.
+        auto place = [&](size_t r) {
+            size_t limit = std::min((r + 1) * range_size, new_count);
+            size_t spilled = range_start[r];
+
+            for (size_t k = range_start[r]; k < range_start[r + 1]; ++k) {
+                Bucket& from = old_buckets[staged[k]];
+                size_t hash_code = from.hash_code_;
+                weak_value_type value = std::move(from.value_);
+                destroy_bucket_(from);
+
+                if (place_before_(limit, hash_code, value)) {
+                    ++placed[r];
+                } else {
+                    construct_bucket_(from, std::move(value));
+                    from.hash_code_ = hash_code;
+                    staged[spilled++] = staged[k];
+                }
+            }
+
+            spilled_end[r] = spilled;
+        };
+        parallel_for(tasks, place);
+
+        size_ = 0;
+        for (size_t count : placed)
+            size_ += count;
+
+        for (size_t r = 0; r < tasks; ++r) {
+            for (size_t k = range_start[r]; k < spilled_end[r]; ++k) {
+                Bucket& from = old_buckets[staged[k]];
+                place_(from.hash_code_, std::move(from.value_));
+                destroy_bucket_(from);
+            }
+        }
+    }
+
+    /// Places `value` by Robin Hood insertion, like `place_`, except that
+    /// it won't go past bucket `limit` (or wrap around). If something has
+    /// to, it's left in `value` and `hash_code`, and this returns false.
+    bool place_before_(size_t limit, size_t& hash_code,
+                       weak_value_type& value)
+    {
+        size_t pos = which_bucket_(hash_code);
+        size_t dist = 0;
+
+        for ( ; pos < limit; ++pos, ++dist) {
+            Bucket& bucket = buckets_[pos];
+
+            if (!bucket.used_) {
+                construct_bucket_(bucket, std::move(value));
+                bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
+                return true;
+            }
+
+            size_t existing_distance = bucket_distance_(pos, bucket);
+            if (dist > existing_distance) {
+                stats_.stole();
+                using std::swap;
+                swap(value, bucket.value_);
+                size_t existing_hash_code = bucket.hash_code_;
+                bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
+                hash_code = existing_hash_code;
+                dist = existing_distance;
             }
         }
+
+        return false;
     }
 
+    /// PRECONDITION: hash_code == hash_(key)
     template <class KeyLike>
-    std::optional<size_t> lookup_(const KeyLike& key) const
+    std::optional<size_t> lookup_(size_t hash_code, const KeyLike& key) const
     {
-        size_t hash_code = hash_(key);
         size_t pos = which_bucket_(hash_code);
         size_t dist = 0;
 
         for (;;) {
             const Bucket& bucket = buckets_[pos];
 
-            if (!bucket.used_)
-                return std::nullopt;
-
-            if (dist > probe_distance_(pos, which_bucket_(bucket.hash_code_)))
+            if (!bucket.used_ || dist > bucket_distance_(pos, bucket)) {
+                stats_.lookup_probed(dist);
                 return std::nullopt;
+            }
 
             if (hash_code == bucket.hash_code_) {
                 const_view_value_type bucket_value_locked = bucket.value_.lock();
+                stats_.locked();
                 if (const key_type* bucket_key =
-                        weak_trait::key(bucket_value_locked))
-                    if (equal_(key, *bucket_key))
+                        weak_trait::key(bucket_value_locked)) {
+                    if (equal_(key, *bucket_key)) {
+                        stats_.lookup_probed(dist);
                         return {pos};
+                    }
+                } else {
+                    stats_.probed_expired();
+                }
             }
 
             pos = next_bucket_(pos);
@@ -683,33 +1588,227 @@ private:
         }
     }
 
-    /// Places `value` in the table, starting at `pos` and moving forward.
-    void steal_(size_t hash_code, size_t pos, strong_value_type&& value)
+    // `weak_hash_table_base`, const if `Self` is, for reaching the old
+    // buckets of a table with the same constness.
+    template <class Self>
+    using same_const_t_ = std::conditional_t<std::is_const_v<Self>,
+                                             const weak_hash_table_base,
+                                             weak_hash_table_base>;
+
+    // Probes like `lookup_`, but keeps the lock it compares keys with, so
+    // that `fn` gets the view without locking again.
+    template <class Self, class KeyLike, class Fn>
+    static bool with_hashed_(Self& self, size_t hash_code,
+                             const KeyLike& key, Fn& fn)
     {
-        size_t dist = probe_distance_(pos, which_bucket_(hash_code));
+        size_t pos = self.which_bucket_(hash_code);
+        size_t dist = 0;
 
+        for (;;) {
+            auto& bucket = self.buckets_[pos];
+
+            if (!bucket.used_ || dist > self.bucket_distance_(pos, bucket)) {
+                self.stats_.lookup_probed(dist);
+                break;
+            }
+
+            if (hash_code == bucket.hash_code_) {
+                auto view = bucket.value_.lock();
+                self.stats_.locked();
+                if (const key_type* bucket_key = weak_trait::key(view)) {
+                    if (self.equal_(key, *bucket_key)) {
+                        self.stats_.lookup_probed(dist);
+                        if (!weak_trait::live(view)) return false;
+                        fn(std::as_const(view));
+                        return true;
+                    }
+                } else {
+                    self.stats_.probed_expired();
+                }
+            }
+
+            pos = self.next_bucket_(pos);
+            ++dist;
+        }
+
+        return self.old_ &&
+               with_hashed_(static_cast<same_const_t_<Self>&>(*self.old_),
+                            hash_code, key, fn);
+    }
+
+    template <class Self, class Fn>
+    static bool for_each_live_(Self& self, Fn& fn)
+    {
+        for (auto& bucket : self.buckets_) {
+            if (!bucket.used_) continue;
+
+            auto view = bucket.value_.lock();
+            self.stats_.locked();
+            if (weak_trait::live(view) &&
+                    !detail::visit_and_continue(fn, std::as_const(view)))
+                return false;
+        }
+
+        return !self.old_ ||
+               for_each_live_(static_cast<same_const_t_<Self>&>(*self.old_),
+                              fn);
+    }
+
+    template <class KeyLike>
+    iterator find_hashed_(size_t hash_code, const KeyLike& key)
+    {
+        if (auto bucket_index = lookup_(hash_code, key))
+            return make_iterator_(bucket_index);
+        else if (auto old_index = lookup_old_(hash_code, key))
+            return make_old_iterator_(*old_index);
+        else
+            return end();
+    }
+
+    template <class KeyLike>
+    const_iterator find_hashed_(size_t hash_code, const KeyLike& key) const
+    {
+        if (auto bucket_index = lookup_(hash_code, key))
+            return make_iterator_(bucket_index);
+        else if (auto old_index = lookup_old_(hash_code, key))
+            return make_old_iterator_(*old_index);
+        else
+            return end();
+    }
+
+    /// Calls `visit(hash_code, key)` for each key in the range, a batch at
+    /// a time: it hashes the whole batch and prefetches the home buckets,
+    /// and only then visits the keys of the batch.
+    template <class ForwardIt, class Visit>
+    void for_each_prefetched_(ForwardIt first, ForwardIt last,
+                              Visit visit) const
+    {
+        std::array<size_t, batch_size_> hash_codes;
+
+        while (first != last) {
+            ForwardIt batch = first;
+            size_t count = 0;
+
+            for ( ; first != last && count < batch_size_; ++first, ++count) {
+                hash_codes[count] = hash_(*first);
+                prefetch_home_(hash_codes[count]);
+            }
+
+            for (size_t i = 0; i < count; ++i, ++batch)
+                visit(hash_codes[i], *batch);
+        }
+    }
+
+    /// Places `value` in the table, starting at `pos` (which is `dist` from
+    /// its home bucket) and moving forward.
+    void steal_(size_t hash_code, size_t pos, size_t dist,
+                strong_value_type&& value)
+    {
         for (;;) {
             Bucket& bucket = buckets_[pos];
 
             if (!bucket.used_) {
                 construct_bucket_(bucket, std::move(value));
                 bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
+                ++size_;
                 return;
             }
 
-            if (bucket.value_.expired()) {
+            // An expired bucket can be taken over only where `value` could
+            // also displace it, or the elements after it might end up
+            // further from home than `value`, where lookups won't find them.
+            size_t existing_distance = bucket_distance_(pos, bucket);
+            if (dist >= existing_distance && bucket.value_.expired()) {
+                stats_.probed_expired();
                 bucket.value_ = std::move(value);
                 bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
                 return;
             }
 
-            size_t existing_distance =
-                    probe_distance_(pos, which_bucket_(bucket.hash_code_));
             if (dist > existing_distance) {
                 auto bucket_locked = bucket.value_.lock();
+                stats_.locked();
+                stats_.stole();
                 bucket.value_ = std::exchange(value, weak_trait::move(bucket_locked));
                 // swap doesn't work because bitfield:
                 bucket.hash_code_ = std::exchange(hash_code, size_t(bucket.hash_code_));
+                set_distance_(bucket, dist);
+                dist = existing_distance;
+            }
+
+            pos = next_bucket_(pos);
+            ++dist;
+        }
+    }
+
+    /// Copies the elements of `other` into this table, which must be empty
+    /// and have the same hasher, reusing their stored hash codes instead of
+    /// hashing their keys again.
+    ///
+    /// With the same number of buckets, this copies the buckets one for
+    /// one, expired elements and all. Otherwise it places each live element
+    /// without locking it, since the keys are known to be distinct.
+    ///
+    /// PRECONDITION: size_ == 0 && !old_
+    void copy_from_(const weak_hash_table_base& other)
+    {
+        if (bucket_count() == other.bucket_count() && !other.old_) {
+            for (size_t i = 0; i < bucket_count(); ++i) {
+                const Bucket& from = other.buckets_[i];
+                if (!from.used_) continue;
+
+                Bucket& to = buckets_[i];
+                construct_bucket_(to, from.value_);
+                to.hash_code_ = from.hash_code_;
+                to.distance_ = from.distance_;
+            }
+
+            size_ = other.size_;
+        } else {
+            reserve_for_insert_(other.size());
+            place_live_(other);
+            if (other.old_) place_live_(*other.old_);
+        }
+    }
+
+    /// Places copies of the live elements of `other`'s buckets.
+    void place_live_(const weak_hash_table_base& other)
+    {
+        for (const Bucket& bucket : other.buckets_) {
+            if (bucket.used_ && !bucket.value_.expired())
+                place_(bucket.hash_code_, bucket.value_);
+        }
+    }
+
+    /// Places `value`, whose key is known not to be present, by Robin Hood
+    /// insertion. It never compares keys, so it never locks anything.
+    void place_(size_t hash_code, weak_value_type value)
+    {
+        size_t pos = which_bucket_(hash_code);
+        size_t dist = 0;
+
+        for (;;) {
+            Bucket& bucket = buckets_[pos];
+
+            if (!bucket.used_) {
+                construct_bucket_(bucket, std::move(value));
+                bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
+                ++size_;
+                return;
+            }
+
+            size_t existing_distance = bucket_distance_(pos, bucket);
+            if (dist > existing_distance) {
+                stats_.stole();
+                using std::swap;
+                swap(value, bucket.value_);
+                size_t existing_hash_code = bucket.hash_code_;
+                bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
+                hash_code = existing_hash_code;
                 dist = existing_distance;
             }
 
@@ -718,6 +1817,53 @@ private:
         }
     }
 
+    /// Grows, if need be, so that `count` more elements fit without
+    /// growing again.
+    void reserve_for_insert_(size_t count)
+    {
+        auto wanted = [&] {
+            size_t total = size() + count;
+            return std::max(size_t(total / max_load_factor()), total) + 1;
+        };
+
+        if (wanted() > bucket_count()) {
+            sweep_before_growing_();
+            if (wanted() > bucket_count()) resize_(wanted());
+        }
+    }
+
+    /// Starts loading the home bucket for `hash_code` into cache.
+    void prefetch_home_(size_t hash_code) const
+    {
+        if (bucket_count() != 0)
+            detail::prefetch(&buckets_[which_bucket_(hash_code)]);
+    }
+
+    /// Inserts in batches, hashing and prefetching each batch before
+    /// probing for any of it.
+    template <typename InputIter>
+    void insert_batched_(InputIter start, InputIter limit)
+    {
+        std::vector<strong_value_type> values;
+        std::array<size_t, batch_size_> hash_codes;
+        values.reserve(batch_size_);
+
+        while (start != limit) {
+            values.clear();
+            for ( ; start != limit && values.size() < batch_size_;
+                  ++start)
+                values.emplace_back(*start);
+
+            for (size_t i = 0; i < values.size(); ++i) {
+                hash_codes[i] = hash_(weak_trait::strong_key(values[i]));
+                prefetch_home_(hash_codes[i]);
+            }
+
+            for (size_t i = 0; i < values.size(); ++i)
+                insert_(hash_codes[i], std::move(values[i]), true);
+        }
+    }
+
     void insert_(size_t hash_code,
                  const strong_value_type& value,
                  bool can_grow)
@@ -767,26 +1913,48 @@ protected:
 
     /// Expects to call exactly one of the parameters `on_uninit`, `on_init`,
     /// and `on_found`, which will (re-)initialize the bucket with the given key.
-    template <class OnUninit, class OnInit, class OnFound>
-    void insert_helper_(const key_type& key,
+    ///
+    /// The key may be anything that the hasher and key equality accept, so
+    /// callers can put off building a `key_type` until `on_uninit` or
+    /// `on_init` needs one.
+    template <class KeyLike, class OnUninit, class OnInit, class OnFound>
+    void insert_helper_(const KeyLike& key,
                         OnUninit on_uninit, OnInit on_init, OnFound on_found,
                         bool can_grow = true)
     {
         insert_helper_(hash_(key), key, on_uninit, on_init, on_found, can_grow);
     }
 
+    /// Returns an iterator to a bucket that `insert_helper_` has just
+    /// passed to one of its callbacks.
+    iterator iterator_to_(Bucket& bucket)
+    {
+        return make_iterator_(size_t(&bucket - &buckets_[0]));
+    }
+
 private:
 
     /// Expects to call exactly one of the parameters `on_uninit`, `on_init`,
     /// and `on_found`, which will (re-)initialize the bucket with the given key.
     ///
     /// PRECONDITION: hash_code == hash_(key)
-    template <class OnUninit, class OnInit, class OnFound>
-    void insert_helper_(size_t hash_code, const key_type& key,
+    template <class KeyLike, class OnUninit, class OnInit, class OnFound>
+    void insert_helper_(size_t hash_code, const KeyLike& key,
                         OnUninit on_uninit, OnInit on_init, OnFound on_found,
                         bool can_grow = true)
     {
-        if (can_grow) maybe_grow_();
+        // When `can_grow` is false, we're placing an element that's known
+        // not to be present, while resizing or migrating.
+        if (can_grow) {
+            remove_tracked_expired_();
+            maybe_grow_();
+            migrate_some_();
+
+            // If the key is still in the old buckets, move it over so that
+            // `on_found` sees it here.
+            if (auto old_index = lookup_old_(hash_code, key))
+                migrate_index_(*old_index);
+        }
 
         size_t pos = which_bucket_(hash_code);
         size_t dist = 0;
@@ -795,35 +1963,55 @@ private:
             Bucket& bucket = buckets_[pos];
 
             if (!bucket.used_) {
+                if (can_grow) stats_.insert_probed(dist);
                 on_uninit(bucket);
                 bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
                 ++size_;
                 return;
             }
 
-            const_view_value_type const_bucket_locked = bucket.value_.lock();
-            auto bucket_key = weak_trait::key(const_bucket_locked);
-            if (!bucket_key) {
-                on_init(bucket);
-                bucket.hash_code_ = hash_code;
-                return;
-            }
-
-            // If not expired, but matches the value to insert, replace.
-            view_value_type bucket_locked = bucket.value_.lock();
-            if (hash_code == bucket.hash_code_ && equal_(key, *bucket_key)) {
-                on_found(bucket);
-                return;
+            // Only a bucket with the same hash code can hold the key, so
+            // that's the only time it's worth locking.
+            if (hash_code == bucket.hash_code_) {
+                const_view_value_type bucket_locked =
+                        std::as_const(bucket.value_).lock();
+                stats_.locked();
+                if (const key_type* bucket_key =
+                        weak_trait::key(bucket_locked)) {
+                    if (equal_(key, *bucket_key)) {
+                        if (can_grow) stats_.insert_probed(dist);
+                        on_found(bucket);
+                        return;
+                    }
+                } else {
+                    stats_.probed_expired();
+                }
             }
 
-            // Otherwise, we check the probe distance.
-            size_t existing_distance =
-                    probe_distance_(pos, which_bucket_(bucket.hash_code_));
+            // Otherwise, we check the probe distance. Reusing an expired
+            // bucket any earlier could insert a duplicate of a key further
+            // along.
+            size_t existing_distance = bucket_distance_(pos, bucket);
             if (dist > existing_distance) {
-                steal_(bucket.hash_code_, next_bucket_(pos),
-                       weak_trait::move(bucket_locked));
-                on_init(bucket);
+                if (can_grow) stats_.insert_probed(dist);
+                if (bucket.value_.expired()) {
+                    stats_.probed_expired();
+                    on_init(bucket);
+                } else {
+                    // If it expires after we checked, we carry along an
+                    // expired element, which is harmless.
+                    view_value_type bucket_locked = bucket.value_.lock();
+                    stats_.locked();
+                    stats_.stole();
+                    steal_(bucket.hash_code_, next_bucket_(pos),
+                           existing_distance + 1,
+                           weak_trait::move(bucket_locked));
+                    on_init(bucket);
+                }
+
                 bucket.hash_code_ = hash_code;
+                set_distance_(bucket, dist);
                 return;
             }
 
@@ -835,7 +2023,7 @@ private:
     template <class KeyLike>
     size_t hash_(const KeyLike& key) const
     {
-        return hasher_(key) & hash_code_mask_;
+        return indexing::mix(hasher_(key)) & hash_code_mask_;
     }
 
     void destroy_bucket_(Bucket& bucket)
@@ -855,20 +2043,33 @@ private:
 
     size_t next_bucket_(size_t pos) const
     {
-        return (pos + 1) % bucket_count();
+        return indexing::next(pos, bucket_count());
     }
 
     size_t probe_distance_(size_t actual, size_t preferred) const
     {
-        if (actual >= preferred)
-            return actual - preferred;
-        else
-            return actual + bucket_count() - preferred;
+        return indexing::distance(actual, preferred, bucket_count());
     }
 
     size_t which_bucket_(size_t hash_code) const
     {
-        return hash_code % bucket_count();
+        return indexing::bucket(hash_code, bucket_count());
+    }
+
+    /// The probe distance of the used bucket at `pos`, from the cache when
+    /// it isn't saturated.
+    size_t bucket_distance_(size_t pos, const Bucket& bucket) const
+    {
+        size_t dist = bucket.distance_;
+        if (dist < saturated_distance_)
+            return dist;
+        else
+            return probe_distance_(pos, which_bucket_(bucket.hash_code_));
+    }
+
+    static void set_distance_(Bucket& bucket, size_t dist)
+    {
+        bucket.distance_ = std::min(dist, saturated_distance_);
     }
 };
 
@@ -877,15 +2078,20 @@ private:
 /// This iterator is invalidated by any operation that changes the hash
 /// table, including a shared pointer expiring.
 ///
+/// The iterator locks each element once as it arrives there and holds on
+/// to the result, so the element it points at stays alive until it moves
+/// on.
+///
 /// This iterator may allow modifying the values, but it does not allow
 /// modifying the keys, since that would destroy the hash invariant.
 template <
         class T,
         class Hash,
         class KeyEqual,
-        class Allocator
+        class Allocator,
+        class Policy
 >
-class weak_hash_table_base<T, Hash, KeyEqual, Allocator>::iterator
+class weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>::iterator
         : public std::iterator<std::forward_iterator_tag, T>
 {
 private:
@@ -894,27 +2100,29 @@ private:
 
     using base_t = typename vector_t::iterator;
 
-    iterator(base_t start, base_t limit)
-            : base_(start), limit_(limit)
+    iterator(base_t start, base_t limit, base_t next, base_t next_limit)
+            : base_(start), limit_(limit), next_(next), next_limit_(next_limit)
     {
         find_next_();
     }
 
+    // An end iterator, which has nothing to look for.
+    explicit iterator(base_t limit)
+            : base_(limit), limit_(limit), next_(), next_limit_()
+    { }
+
 public:
     /// Provides a pointer view of the iterator.
-    ///
-    /// Note that because the value type of the iterator does not exist until
-    /// derereferenced, this operator allocates to return a pointer to it. Thus,
-    /// `operator*() const` is probably more efficient.
-    std::unique_ptr<view_value_type> operator->() const
+    const view_value_type* operator->() const
     {
-        return std::make_unique<view_value_type>(operator*());
+        return view_.operator->();
     }
 
-    /// Returns the value indicated by the iterator.
-    view_value_type operator*() const
+    /// Returns the value indicated by the iterator, as locked when the
+    /// iterator arrived at it.
+    const view_value_type& operator*() const
     {
-        return base_->value_.lock();
+        return *view_;
     }
 
     /// Advances the iterator.
@@ -934,26 +2142,49 @@ public:
     }
 
     /// Iterator equality.
-    bool operator==(iterator other) const
+    bool operator==(const iterator& other) const
     {
         return base_ == other.base_;
     }
 
     /// Iterator disequality.
-    bool operator!=(iterator other) const
+    bool operator!=(const iterator& other) const
     {
         return base_ != other.base_;
     }
 
 private:
-    // Invariant: if base_ != limit_ then base_->occupied();
+    // Invariant: if base_ != limit_ then base_->used_ and view_ holds its
+    // value, locked.
     base_t base_;
     base_t limit_;
+    // The range to continue with after [base_, limit_), if any, which is
+    // the old buckets while rehashing incrementally.
+    base_t next_;
+    base_t next_limit_;
+    detail::view_cache<view_value_type> view_;
 
+    // Locks each used bucket once, stopping at the first live one.
     void find_next_()
     {
-        while (base_ != limit_ && !base_->occupied_())
-            ++base_;
+        for (;;) {
+            for (; base_ != limit_; ++base_) {
+                if (!base_->used_) continue;
+
+                view_value_type view = base_->value_.lock();
+                if (weak_trait::live(view)) {
+                    view_.emplace(std::move(view));
+                    return;
+                }
+            }
+
+            view_.reset();
+            if (next_limit_ == base_t()) return;
+
+            base_ = next_;
+            limit_ = next_limit_;
+            next_ = next_limit_ = base_t();
+        }
     }
 };
 
@@ -961,13 +2192,16 @@ private:
 ///
 /// This iterator is invalidated by any operation that changes the hash
 /// table, including a shared pointer expiring.
+///
+/// Like `iterator`, it keeps the element it points at alive.
 template <
         class T,
         class Hash,
         class KeyEqual,
-        class Allocator
+        class Allocator,
+        class Policy
 >
-class weak_hash_table_base<T, Hash, KeyEqual, Allocator>::const_iterator
+class weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>::const_iterator
         : public std::iterator<std::forward_iterator_tag, const T>
 {
 private:
@@ -975,32 +2209,37 @@ private:
 
     using base_t = typename vector_t::const_iterator;
 
-    const_iterator(base_t start, base_t limit)
-            : base_(start), limit_(limit)
+    const_iterator(base_t start, base_t limit,
+                   base_t next, base_t next_limit)
+            : base_(start), limit_(limit), next_(next), next_limit_(next_limit)
     {
         find_next_();
     }
 
+    // An end iterator, which has nothing to look for.
+    explicit const_iterator(base_t limit)
+            : base_(limit), limit_(limit), next_(), next_limit_()
+    { }
+
 public:
     /// Implicit conversion from `iterator` to `const_iterator`.
     const_iterator(iterator other)
             : base_(other.base_), limit_(other.limit_)
+            , next_(other.next_), next_limit_(other.next_limit_)
+            , view_(other.view_)
     { }
 
     /// Provides a pointer view of the iterator.
-    ///
-    /// Note that because the value type of the iterator does not exist until
-    /// derereferenced, this operator allocates to return a pointer to it. Thus,
-    /// `operator*() const` is probably more efficient.
-    std::unique_ptr<const_view_value_type> operator->() const
+    const const_view_value_type* operator->() const
     {
-        return std::make_unique<const_view_value_type>(operator*());
+        return view_.operator->();
     }
 
-    /// Returns the value indicated by the iterator.
-    const_view_value_type operator*() const
+    /// Returns the value indicated by the iterator, as locked when the
+    /// iterator arrived at it.
+    const const_view_value_type& operator*() const
     {
-        return base_->value_.lock();
+        return *view_;
     }
 
     /// Advances the iterator.
@@ -1020,36 +2259,69 @@ public:
     }
 
     /// Iterator equality.
-    bool operator==(const_iterator other) const
+    bool operator==(const const_iterator& other) const
     {
         return base_ == other.base_;
     }
 
     /// Iterator disequality.
-    bool operator!=(const_iterator other) const
+    bool operator!=(const const_iterator& other) const
     {
         return base_ != other.base_;
     }
 
 private:
-    // Invariant: if base_ != limit_ then base_->occupied();
+    // Invariant: if base_ != limit_ then base_->used_ and view_ holds its
+    // value, locked.
     base_t base_;
     base_t limit_;
+    // The range to continue with after [base_, limit_), if any, which is
+    // the old buckets while rehashing incrementally.
+    base_t next_;
+    base_t next_limit_;
+    detail::view_cache<const_view_value_type> view_;
 
+    // Locks each used bucket once, stopping at the first live one.
     void find_next_()
     {
-        while (base_ != limit_ && !base_->occupied_())
-            ++base_;
+        for (;;) {
+            for (; base_ != limit_; ++base_) {
+                if (!base_->used_) continue;
+
+                const_view_value_type view = base_->value_.lock();
+                if (weak_trait::live(view)) {
+                    view_.emplace(std::move(view));
+                    return;
+                }
+            }
+
+            view_.reset();
+            if (next_limit_ == base_t()) return;
+
+            base_ = next_;
+            limit_ = next_limit_;
+            next_ = next_limit_ = base_t();
+        }
     }
 };
 
 /// Swaps the contents of two weak hash tables in constant time.
-template <class T, class Hash, class KeyEqual, class Allocator>
-void swap(weak_hash_table_base<T, Hash, KeyEqual, Allocator>& a,
-          weak_hash_table_base<T, Hash, KeyEqual, Allocator>& b)
+template <class T, class Hash, class KeyEqual, class Allocator, class Policy>
+void swap(weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>& a,
+          weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     a.swap(b);
 }
 
-} // end namespace weak
+/// Constructs a `U` whose expiry `table` will hear about; see
+/// `weak_hash_table_base::make_tracked`.
+template <class U, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy, class... Args>
+std::shared_ptr<U>
+make_tracked(weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>& table,
+             Args&&... args)
+{
+    return table.template make_tracked<U>(std::forward<Args>(args)...);
+}
 
+} // end namespace weak
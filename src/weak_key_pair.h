@@ -1,6 +1,9 @@
 #include "weak_traits.h"
 
+#include <cstddef>
 #include <memory>
+#include <tuple>
+#include <utility>
 
 namespace weak {
 
@@ -30,12 +33,28 @@ struct weak_key_pair
             : first(strong.first), second(strong.second)
     { }
 
+    /// Constructs a weak pair from a strong pair, moving the value.
+    weak_key_pair(strong_type&& strong)
+            : first(std::move(strong.first)), second(std::move(strong.second))
+    { }
+
     /// Constructs a weak pair from the given key and value.
     template <class K, class V>
     weak_key_pair(K&& key, V&& value)
             : first(std::forward<K>(key)), second(std::forward<V>(value))
     { }
 
+    /// Constructs a weak pair whose components are constructed in place
+    /// from the given tuples of arguments, as with `std::pair`.
+    template <class... KArgs, class... VArgs>
+    weak_key_pair(std::piecewise_construct_t,
+                  std::tuple<KArgs...> key_args,
+                  std::tuple<VArgs...> value_args)
+            : weak_key_pair(key_args, value_args,
+                            std::index_sequence_for<KArgs...>{},
+                            std::index_sequence_for<VArgs...>{})
+    { }
+
     /// Is this weak pair expired?
     ///
     /// A weak key pair is expired if the first component is expired.
@@ -61,12 +80,22 @@ struct weak_key_pair
         return {strong.first, strong.second};
     }
 
-    /// Gets a pointer to the key from a view pair.
-    static const first_type* key(const_view_type& view)
+    /// Gets a pointer to the key from a view or const view pair.
+    template <class View>
+    static const first_type* key(const View& view)
     {
         return view.first.get();
     }
 
+    /// Does a view or const view pair hold a live element?
+    ///
+    /// A view of a weak key pair is live if it holds the key.
+    template <class View>
+    static bool live(const View& view)
+    {
+        return view.first != nullptr;
+    }
+
     /// Gets a pointer to the key from a strong pair.
     static const first_type& strong_key(const strong_type& strong)
     {
@@ -78,6 +107,16 @@ struct weak_key_pair
     {
         return {std::move(view.first), std::move(view.second)};
     }
+
+private:
+    template <class... KArgs, class... VArgs, size_t... KIs, size_t... VIs>
+    weak_key_pair(std::tuple<KArgs...>& key_args,
+                  std::tuple<VArgs...>& value_args,
+                  std::index_sequence<KIs...>,
+                  std::index_sequence<VIs...>)
+            : first(std::forward<KArgs>(std::get<KIs>(key_args))...)
+            , second(std::forward<VArgs>(std::get<VIs>(value_args))...)
+    { }
 };
 
 } // end namespace weak
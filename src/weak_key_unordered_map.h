@@ -1,10 +1,13 @@
 #pragma once
 
 #include "weak_hash_table_base.h"
+#include "weak_swiss_table_base.h"
 #include "weak_traits.h"
 #include "weak_key_pair.h"
 
 #include <functional>
+#include <tuple>
+#include <utility>
 
 namespace weak {
 
@@ -15,48 +18,183 @@ namespace weak {
 template<class Key, class T,
          class Hash = std::hash<Key>,
          class KeyEqual = std::equal_to<>,
-         class Allocator = std::allocator<weak_key_pair<Key, T>>>
+         class Allocator = std::allocator<weak_key_pair<Key, T>>,
+         class Policy = default_table_policy>
 class weak_key_unordered_map
-        : public weak_hash_table_base<weak_key_pair<Key, T>, Hash, KeyEqual, Allocator>
+        : public weak_table_base_t<
+                weak_key_pair<Key, T,
+                              typename Policy::template weak_pointer<const Key>>,
+                Hash, KeyEqual, Allocator, Policy>
 {
-    using BaseClass = weak_hash_table_base<weak_key_pair<Key, T>, Hash, KeyEqual, Allocator>;
+    using BaseClass = weak_table_base_t<
+            weak_key_pair<Key, T,
+                          typename Policy::template weak_pointer<const Key>>,
+            Hash, KeyEqual, Allocator, Policy>;
     using typename BaseClass::Bucket;
 public:
-    using BaseClass::weak_hash_table_base;
+    using typename BaseClass::iterator;
+
+    using BaseClass::BaseClass;
+
+    /// The strong pointers to keys, `std::shared_ptr<const Key>` by default.
+    using key_pointer = typename BaseClass::weak_value_type::first_pointer;
+
+    /// Looks up the given key in the hash table, returning a reference to
+    /// the value.
+    ///
+    /// If the key doesn't exist then it is inserted and the value default
+    /// constructed in place.
+    T& operator[](const key_pointer& key)
+    {
+        return subscript_(key);
+    }
 
     /// Looks up the given key in the hash table, returning a reference to
     /// the value.
     ///
     /// If the key doesn't exist then it is inserted and the value default
-    /// constructed.
-    T& operator[](const std::shared_ptr<const Key>& key)
+    /// constructed in place.
+    T& operator[](key_pointer&& key)
+    {
+        return subscript_(std::move(key));
+    }
+
+    /// Maps the given key to a value constructed in place from `args`,
+    /// unless the key is already present, in which case `args` are left
+    /// alone. Returns an iterator to the association and whether it was
+    /// inserted.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_pointer& key,
+                                          Args&&... args)
+    {
+        return try_emplace_(key, std::forward<Args>(args)...);
+    }
+
+    /// Maps the given key to a value constructed in place from `args`,
+    /// unless the key is already present, in which case `args` are left
+    /// alone. Returns an iterator to the association and whether it was
+    /// inserted.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_pointer&& key, Args&&... args)
+    {
+        return try_emplace_(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /// Maps the given key to `value`, replacing any value it already has.
+    /// Returns an iterator to the association and whether it was inserted.
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_pointer& key,
+                                               M&& value)
+    {
+        return insert_or_assign_(key, std::forward<M>(value));
+    }
+
+    /// Maps the given key to `value`, replacing any value it already has.
+    /// Returns an iterator to the association and whether it was inserted.
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(key_pointer&& key, M&& value)
+    {
+        return insert_or_assign_(std::move(key), std::forward<M>(value));
+    }
+
+private:
+    template <class K>
+    T& subscript_(K&& key)
     {
         T* result;
 
         BaseClass::insert_helper_(
                 *key,
                 [&](Bucket& bucket) {
-                    BaseClass::construct_bucket_(bucket, key, T());
+                    BaseClass::construct_bucket_(
+                            bucket, std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::tuple<>());
                     result = &bucket.value().second;
                 },
                 [&](Bucket& bucket) {
-                    bucket.value().first = key;
-                    bucket.value().second = T();
+                    bucket.value() = typename BaseClass::weak_value_type(
+                            std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::tuple<>());
                     result = &bucket.value().second;
                 },
                 [&](Bucket& bucket) {
-                    bucket.value().first = key;
+                    bucket.value().first = std::forward<K>(key);
                     result = &bucket.value().second;
                 });
 
         return *result;
     }
+
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace_(K&& key, Args&&... args)
+    {
+        Bucket* result_bucket;
+        bool inserted = true;
+
+        BaseClass::insert_helper_(
+                *key,
+                [&](Bucket& bucket) {
+                    BaseClass::construct_bucket_(
+                            bucket, std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(
+                                    std::forward<Args>(args)...));
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    // The old value belongs to an expired key, so we can
+                    // replace the whole pair.
+                    bucket.value() = typename BaseClass::weak_value_type(
+                            std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(
+                                    std::forward<Args>(args)...));
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    inserted = false;
+                    result_bucket = &bucket;
+                });
+
+        return {BaseClass::iterator_to_(*result_bucket), inserted};
+    }
+
+    template <class K, class M>
+    std::pair<iterator, bool> insert_or_assign_(K&& key, M&& value)
+    {
+        Bucket* result_bucket;
+        bool inserted = true;
+
+        BaseClass::insert_helper_(
+                *key,
+                [&](Bucket& bucket) {
+                    BaseClass::construct_bucket_(bucket, std::forward<K>(key),
+                                                 std::forward<M>(value));
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    bucket.value().first = std::forward<K>(key);
+                    bucket.value().second = std::forward<M>(value);
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    bucket.value().first = std::forward<K>(key);
+                    bucket.value().second = std::forward<M>(value);
+                    inserted = false;
+                    result_bucket = &bucket;
+                });
+
+        return {BaseClass::iterator_to_(*result_bucket), inserted};
+    }
 };
 
 /// Swaps two `weak_key_unordered_map`s in constant time.
-template<class Key, class T, class Hash, class KeyEqual, class Allocator>
-void swap(weak_key_unordered_map <Key, T, Hash, KeyEqual, Allocator>& a,
-          weak_key_unordered_map <Key, T, Hash, KeyEqual, Allocator>& b)
+template<class Key, class T, class Hash, class KeyEqual, class Allocator,
+         class Policy>
+void swap(weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+          weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     a.swap(b);
 }
@@ -67,10 +205,10 @@ void swap(weak_key_unordered_map <Key, T, Hash, KeyEqual, Allocator>& a,
 /// according to `compare`. Function `compare` defaults to equality, but
 /// other relations are possible.
 template <class Key, class T, class Hash, class KeyEqual, class Allocator,
-          class TEqual = std::equal_to<>>
+          class Policy, class TEqual = std::equal_to<>>
 bool submap(
-        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b,
+        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b,
         TEqual compare = TEqual())
 {
     for (const auto& elem : a) {
@@ -83,26 +221,29 @@ bool submap(
 }
 
 /// Are the keys of `a` a subset of the keys of `b`?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
 bool keys_subset(
-        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+        const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
-    submap(a, b, [](const auto&, const auto&) { return true; });
+    return submap(a, b, [](const auto&, const auto&) { return true; });
 }
 
 /// Are the given maps equal?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
-bool operator==(const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-                const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
+bool operator==(const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return submap(a, b) && keys_subset(b, a);
 }
 
 /// Are the given maps unequal?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
-bool operator!=(const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-                const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
+bool operator!=(const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_key_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return !(a == b);
 }
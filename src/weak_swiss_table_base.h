@@ -0,0 +1,1620 @@
+#pragma once
+
+#include "detail/control_group.h"
+#include "detail/parallel_for.h"
+#include "detail/prefetch.h"
+#include "detail/raw_vector.h"
+#include "detail/view_cache.h"
+#include "detail/visit.h"
+#include "weak_table_policy.h"
+#include "weak_traits.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace weak {
+
+/// A weak hash table with Swiss-table style metadata.
+///
+/// This provides the same interface as `weak_hash_table_base`, and can be
+/// used in its place as the base of the derived tables by selecting
+/// `swiss_policy`. Rather than interleaving metadata with the elements, it
+/// keeps a separate array of one-byte control tags, each of which marks its
+/// slot empty, deleted, or full with seven bits of the slot's hash code.
+/// Probing compares a whole group of tags at once (with SSE2 where
+/// available), and only touches a slot, and locks its weak pointer, when
+/// the slot's tag matches.
+///
+/// Erasing leaves a tombstone unless the slot was never part of a full
+/// group, and tombstones are reclaimed when the table rehashes. Capacities
+/// are always powers of two, at least the group width.
+template <
+        class T,
+        class Hash = std::hash<typename weak_traits<T>::key_type>,
+        class KeyEqual = std::equal_to<>,
+        class Allocator = std::allocator<T>,
+        class Policy = swiss_policy
+>
+class weak_swiss_table_base
+{
+public:
+    /// The actual value type stored by the hash table.
+    using weak_value_type       = T;
+    /// The instance of `weak_traits` for `weak_value_type`.
+    using weak_trait            = weak_traits<weak_value_type>;
+    /// The value type as viewed from an `iterator`.
+    using view_value_type       = typename weak_trait::view_type;
+    /// The value type as viewed from a `const_iterator`.
+    using const_view_value_type = typename weak_trait::const_view_type;
+    /// A fully owned and present value type, as required by insertion.
+    using strong_value_type     = typename weak_trait::strong_type;
+    /// The type of keys for this table.
+    using key_type              = typename weak_trait::key_type;
+    using hasher                = Hash;
+    using key_equal             = KeyEqual;
+    using allocator_type        = Allocator;
+    using policy_type           = Policy;
+
+    static_assert(std::is_same_v<typename Policy::stats, no_table_stats>,
+                  "the Swiss engine keeps no stats");
+    static_assert(std::is_same_v<typename Policy::growth, doubling_growth>,
+                  "the Swiss engine has its own growth rule");
+
+    /// The default number of buckets to allocate in a new hash table.
+    static constexpr size_t default_bucket_count = 16;
+
+    /// The default maximum load factor that determines when to grow.
+    static constexpr float default_max_load_factor = 0.875;
+
+    /// The default minimum load factor that determines when to shrink.
+    static constexpr float default_min_load_factor = 0.1;
+
+private:
+    using group = detail::control_group;
+    using ctrl_t = detail::ctrl_t;
+
+    // How many elements a bulk insert or lookup hashes and prefetches
+    // ahead of probing for them.
+    static constexpr size_t batch_size_ = 16;
+
+protected:
+    /// A bucket, which contains the stored `weak_value_type` along with its
+    /// full hash code. Whether it is in use is recorded in the control
+    /// array, not in the bucket.
+    class Bucket
+    {
+    public:
+        /// Returns a reference to the stored `weak_value_type`.
+        ///
+        /// This should not be presumed initialized or uninitialized without further
+        /// contextual information.
+        weak_value_type& value()
+        {
+            return value_;
+        }
+
+        /// Returns a constant reference to the stored `weak_value_type`.
+        ///
+        /// This should not be presumed initialized or uninitialized without further
+        /// contextual information.
+        const weak_value_type& value() const
+        {
+            return value_;
+        }
+
+    private:
+        weak_value_type value_;
+        size_t          hash_code_;
+        // INVARIANT:
+        //   - if the control byte for this bucket is full then value_ and
+        //     hash_code_ are initialized, otherwise not
+
+        friend class weak_swiss_table_base;
+    };
+
+private:
+    using bucket_allocator_type =
+        typename std::allocator_traits<allocator_type>
+            ::template rebind_alloc<Bucket>;
+    using weak_value_allocator_type =
+        typename std::allocator_traits<allocator_type>
+            ::template rebind_alloc<weak_value_type>;
+    using ctrl_allocator_type =
+        typename std::allocator_traits<allocator_type>
+            ::template rebind_alloc<ctrl_t>;
+
+    using vector_t = detail::raw_vector<Bucket, bucket_allocator_type>;
+    using ctrl_vector_t = detail::raw_vector<ctrl_t, ctrl_allocator_type>;
+
+public:
+
+    /// Constructs a new, empty weak hash table of default bucket count.
+    weak_swiss_table_base()
+            : weak_swiss_table_base(default_bucket_count)
+    { }
+
+    /// Constructs a new, empty weak hash table of the given
+    /// bucket count.
+    explicit weak_swiss_table_base(
+        size_t bucket_count,
+        const hasher& hash = hasher(),
+        const key_equal& equal = key_equal(),
+        const allocator_type& allocator = allocator_type())
+            : hasher_(hash)
+            , equal_(equal)
+            , bucket_allocator_(allocator)
+            , weak_value_allocator_(allocator)
+            , ctrl_allocator_(allocator)
+            , max_load_factor_(default_max_load_factor)
+            , min_load_factor_(default_min_load_factor)
+            , ctrl_(ctrl_size_(capacity_for_(bucket_count)), ctrl_allocator_)
+            , buckets_(capacity_for_(bucket_count), bucket_allocator_)
+            , size_(0)
+            , sweep_cursor_(0)
+            , swept_since_resize_(0)
+            , reserved_bucket_count_(bucket_count)
+    {
+        init_ctrl_();
+    }
+
+    /// Constructs a new, empty weak hash table of the given
+    /// bucket count, using the given allocator.
+    weak_swiss_table_base(
+        size_t bucket_count,
+        const allocator_type& allocator)
+            : weak_swiss_table_base(bucket_count, hasher(), key_equal(),
+                                    allocator)
+    { }
+
+    /// Constructs a new, empty weak hash table of the given bucket count,
+    /// using the given hasher and allocator.
+    weak_swiss_table_base(
+        size_t bucket_count,
+        const hasher& hash,
+        const allocator_type& allocator)
+            : weak_swiss_table_base(bucket_count, hash, key_equal(), allocator)
+    { }
+
+    /// Constructs a new, empty weak hash table of default bucket count,
+    /// using the given allocator.
+    explicit weak_swiss_table_base(
+        const allocator_type& allocator)
+            : weak_swiss_table_base(default_bucket_count,
+                                    hasher(),
+                                    key_equal(),
+                                    allocator)
+    { }
+
+    /// Constructs a new weak hash table of the given bucket count,
+    /// filling it with elements from the range [first, last).
+    template <class InputIt>
+    weak_swiss_table_base(
+        InputIt first, InputIt last,
+        size_t bucket_count = default_bucket_count,
+        const hasher& hash = hasher(),
+        const key_equal& equal = key_equal(),
+        const allocator_type& allocator = allocator_type())
+            : weak_swiss_table_base(bucket_count, hash, equal, allocator)
+    {
+        insert(first, last);
+    }
+
+    /// Constructs a new weak hash table of the given bucket count,
+    /// using the given allocator, and filling it with elements from
+    /// the range [first, last).
+    template <class InputIt>
+    weak_swiss_table_base(
+            InputIt first, InputIt last,
+            size_t bucket_count,
+            const allocator_type& allocator)
+            : weak_swiss_table_base(first, last, bucket_count,
+                                    hasher(), key_equal(), allocator)
+    { }
+
+    /// Constructs a new weak hash table of the given bucket count,
+    /// using the given allocator and hasher, and filling it with
+    /// elements from the range [first, last).
+    template <class InputIt>
+    weak_swiss_table_base(
+        InputIt first, InputIt last,
+        size_t bucket_count,
+        const hasher& hash,
+        const allocator_type& allocator)
+            : weak_swiss_table_base(first, last, bucket_count,
+                                    hash, key_equal(), allocator)
+    { }
+
+    /// Copy constructor.
+    weak_swiss_table_base(const weak_swiss_table_base& other)
+            : weak_swiss_table_base(other, other.get_allocator())
+    { }
+
+    /// Copy constructor with allocator.
+    ///
+    /// This takes the same capacity as `other` so that it can copy the
+    /// buckets and control bytes one for one.
+    weak_swiss_table_base(const weak_swiss_table_base& other,
+                          const allocator_type& allocator)
+            : weak_swiss_table_base(other.bucket_count(),
+                                    other.hasher_,
+                                    other.equal_,
+                                    allocator)
+    {
+        max_load_factor(other.max_load_factor());
+        min_load_factor(other.min_load_factor());
+        reserved_bucket_count_ = other.reserved_bucket_count_;
+        copy_from_(other);
+    }
+
+    /// Move constructor.
+    weak_swiss_table_base(weak_swiss_table_base&& other)
+            : weak_swiss_table_base(0)
+    {
+        swap(other);
+    }
+
+    /// Move constructor with allocator.
+    weak_swiss_table_base(weak_swiss_table_base&& other,
+                          const allocator_type& allocator)
+            : weak_swiss_table_base(0)
+    {
+        swap(other);
+        bucket_allocator_ = allocator;
+        weak_value_allocator_ = allocator;
+        ctrl_allocator_ = allocator;
+    }
+
+    /// Constructs from an initializer list of values.
+    weak_swiss_table_base(std::initializer_list<strong_value_type> elements,
+                          size_t bucket_count = default_bucket_count,
+                          const hasher& hash = hasher(),
+                          const key_equal& equal = key_equal(),
+                          const allocator_type& allocator = allocator_type())
+            : weak_swiss_table_base(bucket_count, hash, equal, allocator)
+    {
+        insert(elements.begin(), elements.end());
+    }
+
+    /// Constructs from an initializer list of values, with the given
+    /// bucket count and allocator.
+    weak_swiss_table_base(std::initializer_list<strong_value_type> elements,
+                          size_t bucket_count,
+                          const allocator_type& allocator)
+            : weak_swiss_table_base(elements, bucket_count, hasher(),
+                                    key_equal(), allocator)
+    { }
+
+    /// Construct from an initializer list of values, with the given
+    /// bucket count, hasher, and allocator.
+    weak_swiss_table_base(std::initializer_list<strong_value_type> elements,
+                          size_t bucket_count,
+                          const hasher& hash,
+                          const allocator_type& allocator)
+            : weak_swiss_table_base(elements, bucket_count, hash,
+                                    key_equal(), allocator)
+    { }
+
+    /// Destructor.
+    ~weak_swiss_table_base()
+    {
+        clear();
+    }
+
+    /// Copy-assignment.
+    weak_swiss_table_base& operator=(const weak_swiss_table_base& other)
+    {
+        if (this != &other) {
+            clear();
+            hasher_ = other.hasher_;
+            equal_ = other.equal_;
+            copy_from_(other);
+        }
+
+        return *this;
+    }
+
+    /// Move-assignment.
+    weak_swiss_table_base& operator=(weak_swiss_table_base&& other)
+    {
+        clear();
+        swap(other);
+        return *this;
+    }
+
+    /// Returns the allocator.
+    allocator_type get_allocator() const
+    {
+        return {bucket_allocator_};
+    }
+
+    /// Returns the key equality predicate.
+    key_equal key_eq() const
+    {
+        return equal_;
+    }
+
+    /// Returns the hash function.
+    hasher hash_function() const
+    {
+        return hasher_;
+    }
+
+    /// If weak pointers have expired, an empty hash table may appear
+    /// non-empty.
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    /// The number of open-addressed buckets.
+    size_t bucket_count() const
+    {
+        return buckets_.size();
+    }
+
+    /// The current load factor.
+    ///
+    /// This over-approximates the proportion of used buckets.
+    float load_factor() const
+    {
+        if (bucket_count() == 0) return 1;
+        return float(size_) / bucket_count();
+    }
+
+    /// The maximum load factor, exceeding which will trigger growth.
+    ///
+    /// Tombstones left by erasing count against this as well.
+    float max_load_factor() const
+    {
+        return max_load_factor_;
+    }
+
+    /// Sets the maximum load factor.
+    //
+    /// *PRECONDITION*: 0 < `new_value` < 1
+    void max_load_factor(float new_value)
+    {
+        assert(0 < new_value && new_value < 1);
+        max_load_factor_ = new_value;
+        growth_limit_ = capacity_to_growth_(bucket_count());
+    }
+
+    /// The minimum load factor, falling below which when elements are
+    /// removed will trigger shrinking.
+    ///
+    /// This defaults to `default_min_load_factor`, so a table whose
+    /// elements mostly expire gives back its buckets on the next erase,
+    /// `remove_expired()` or `sweep_some()`, paying for a rehash to do so.
+    /// Set it to 0 to keep the buckets instead.
+    float min_load_factor() const
+    {
+        return min_load_factor_;
+    }
+
+    /// Sets the minimum load factor. Setting it to 0 disables automatic
+    /// shrinking.
+    ///
+    /// A table that shrinks is rehashed to half its maximum load factor,
+    /// so it won't grow or shrink again right away. It never shrinks on its
+    /// own below the bucket count asked for through the constructor or
+    /// `reserve()`, so a table sized up front stays that size while it
+    /// fills; only `shrink_to_fit()` goes lower.
+    ///
+    /// *PRECONDITION*: 0 <= `new_value` < `max_load_factor() / 2`
+    void min_load_factor(float new_value)
+    {
+        assert(0 <= new_value && new_value < max_load_factor() / 2);
+        min_load_factor_ = new_value;
+    }
+
+    /// Note that because pointers may expire without the table finding
+    /// out, size() is generally an overapproximation of the number of
+    /// elements in the hash table.
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /// Removes all elements.
+    void clear()
+    {
+        for (size_t i = 0; i < bucket_count(); ++i) {
+            if (detail::ctrl_is_full(ctrl_[i])) {
+                destroy_bucket_(buckets_[i]);
+            }
+        }
+
+        size_ = 0;
+        init_ctrl_();
+    }
+
+    /// Cleans up expired elements. After this, `size()` is accurate.
+    ///
+    /// This may shrink the table; see `min_load_factor()`.
+    void remove_expired()
+    {
+        remove_expired_();
+        maybe_shrink_();
+    }
+
+    /// Cleans up expired elements like `remove_expired()`, sweeping on
+    /// `threads` threads, the calling one included.
+    ///
+    /// A sweep spends most of its time missing cache on the weak pointers'
+    /// control blocks, which threads can wait on side by side. The weak
+    /// pointers must be safe to release on any thread, so this isn't for
+    /// tables of `local_weak_ptr`s.
+    void remove_expired(size_t threads)
+    {
+        remove_expired(threads, detail::thread_per_task{});
+    }
+
+    /// Cleans up expired elements like `remove_expired()`, splitting the
+    /// buckets into `tasks` chunks for the given executor to sweep.
+    ///
+    /// `parallel_for(tasks, sweep)` must call `sweep(i)` once for each `i`
+    /// in `[0, tasks)`, on whatever threads it likes, and return once
+    /// they've all returned. The chunks' elements are destroyed in
+    /// parallel; their control bytes, which depend on their neighbors',
+    /// are then released in order on the calling thread.
+    template <class ParallelFor>
+    void remove_expired(size_t tasks, ParallelFor&& parallel_for)
+    {
+        tasks = std::max(tasks, size_t(1));
+        size_t n = bucket_count();
+
+        // A bit per bucket, set once its element is destroyed. Each chunk
+        // is whole words, so no two tasks write the same one.
+        std::vector<uint32_t> destroyed((n + 31) / 32, 0);
+        size_t words = destroyed.size();
+
+        auto sweep = [&](size_t t) {
+            size_t start = t * words / tasks * 32;
+            size_t limit = std::min((t + 1) * words / tasks * 32, n);
+            for (size_t i = start; i < limit; ++i) {
+                if (detail::ctrl_is_full(ctrl_[i]) &&
+                        buckets_[i].value_.expired()) {
+                    destroy_bucket_(buckets_[i]);
+                    destroyed[i / 32] |= uint32_t(1) << (i % 32);
+                }
+            }
+        };
+
+        parallel_for(tasks, sweep);
+
+        for (size_t w = 0; w < words; ++w)
+            for (uint32_t bits = destroyed[w]; bits; bits &= bits - 1)
+                release_ctrl_(w * 32 + detail::lowest_bit_index(bits));
+
+        maybe_shrink_();
+    }
+
+    /// Cleans up expired elements in at most `max_buckets` buckets,
+    /// continuing from where the previous call left off and wrapping around
+    /// at the end. Returns the number of elements removed.
+    ///
+    /// Calling this regularly, such as after each operation or when idle,
+    /// spreads the work of `remove_expired()` out into bounded steps. Once
+    /// it has covered the whole table, growing no longer needs a full
+    /// sweep first. (Like `remove_expired()`, though, it may shrink the
+    /// table.)
+    size_t sweep_some(size_t max_buckets)
+    {
+        size_t old_size = size_;
+        size_t count = std::min(max_buckets, bucket_count());
+
+        for (size_t i = 0; i < count; ++i) {
+            if (sweep_cursor_ >= bucket_count()) sweep_cursor_ = 0;
+            if (detail::ctrl_is_full(ctrl_[sweep_cursor_]) &&
+                    buckets_[sweep_cursor_].value_.expired()) {
+                erase_index_(sweep_cursor_);
+            }
+            ++sweep_cursor_;
+        }
+
+        swept_since_resize_ += count;
+        size_t removed = old_size - size_;
+        maybe_shrink_();
+        return removed;
+    }
+
+    /// Removes expired elements and then shrinks the table to the fewest
+    /// buckets that keep it within the maximum load factor.
+    ///
+    /// This also forgets the bucket counts asked for earlier, so that
+    /// automatic shrinking may go below them (see `min_load_factor()`).
+    void shrink_to_fit()
+    {
+        remove_expired_();
+        reserved_bucket_count_ = 0;
+        resize_(0);
+    }
+
+    /// Reserves room for `extra` additional elements.
+    ///
+    /// The table won't shrink on its own below the resulting bucket count.
+    void reserve(size_t extra)
+    {
+        sweep_before_resize_();
+        reserved_bucket_count_ =
+                std::max(reserved_bucket_count_, size() + extra);
+        resize_(size() + extra);
+    }
+
+    /// Inserts an element.
+    void insert(const strong_value_type& value)
+    {
+        size_t hash_code = hash_(weak_trait::strong_key(value));
+        insert_(hash_code, value);
+    }
+
+    /// Inserts an element.
+    void insert(strong_value_type&& value)
+    {
+        size_t hash_code = hash_(weak_trait::strong_key(value));
+        insert_(hash_code, std::move(value));
+    }
+
+    /// Inserts a range of elements.
+    ///
+    /// This hashes each batch of elements and prefetches where their
+    /// probes start before inserting any of them. Given forward iterators,
+    /// it makes room for the whole range at once, so that the table grows
+    /// (and sweeps out expired elements) at most once.
+    template <typename InputIter>
+    void insert(InputIter start, InputIter limit)
+    {
+        using category =
+                typename std::iterator_traits<InputIter>::iterator_category;
+
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>)
+            reserve_for_insert_(size_t(std::distance(start, limit)));
+
+        insert_batched_(start, limit);
+    }
+
+    /// Inserts an element constructed from the given arguments.
+    ///
+    /// The strong value is built once and then moved into its bucket, so
+    /// passing rvalue pointers costs no extra reference counting.
+    template <class... Args>
+    void emplace(Args&&... args)
+    {
+        insert(strong_value_type(std::forward<Args>(args)...));
+    }
+
+    /// Erases the element if the given key, returning whether an
+    /// element was actually erased.
+    ///
+    /// Like `find`, this takes anything that the hasher and key equality
+    /// accept, so a transparent hasher can avoid building a `key_type`.
+    template <class KeyLike = key_type>
+    bool erase(const KeyLike& key)
+    {
+        if (auto bucket_index = lookup_(key)) {
+            erase_index_(*bucket_index);
+            maybe_shrink_();
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    /// Swaps this weak hash table with another in constant time.
+    void swap(weak_swiss_table_base& other)
+    {
+        using std::swap;
+        swap(ctrl_, other.ctrl_);
+        swap(buckets_, other.buckets_);
+        swap(size_, other.size_);
+        swap(sweep_cursor_, other.sweep_cursor_);
+        swap(swept_since_resize_, other.swept_since_resize_);
+        swap(reserved_bucket_count_, other.reserved_bucket_count_);
+        swap(deleted_, other.deleted_);
+        swap(growth_limit_, other.growth_limit_);
+        swap(hasher_, other.hasher_);
+        swap(equal_, other.equal_);
+        swap(bucket_allocator_, other.bucket_allocator_);
+        swap(weak_value_allocator_, other.weak_value_allocator_);
+        swap(ctrl_allocator_, other.ctrl_allocator_);
+        swap(max_load_factor_, other.max_load_factor_);
+        swap(min_load_factor_, other.min_load_factor_);
+    }
+
+    /// Is the given key mapped by this hash table?
+    template <class KeyLike>
+    bool member(const KeyLike& key) const
+    {
+        return lookup_(key) != std::nullopt;
+    }
+
+    /// Counts the number of times the `key` appears (0 or 1).
+    template <class KeyLike>
+    size_t count(const KeyLike& key) const
+    {
+        return member(key)? 1 : 0;
+    }
+
+    class iterator;
+    class const_iterator;
+
+    /// Returns an iterator to the given key, or `this->end()` if not found.
+    template <class KeyLike>
+    iterator find(const KeyLike& key)
+    {
+        return make_iterator_(lookup_(key));
+    }
+
+    /// Returns an iterator to the given key, or `this->end()` if not found.
+    template <class KeyLike>
+    const_iterator find(const KeyLike& key) const
+    {
+        return make_iterator_(lookup_(key));
+    }
+
+    /// Looks up each key in the range `[first, last)`, writing an iterator
+    /// to it, or `this->end()` if not found, to `out`. Returns `out` past
+    /// the last iterator written.
+    ///
+    /// Rather than finishing each lookup before starting the next, this
+    /// hashes a batch of keys and prefetches where their probes start
+    /// before probing for any of them, so that their cache misses overlap.
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out)
+    {
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = make_iterator_(
+                                         lookup_(hash_code, key));
+                             });
+        return out;
+    }
+
+    /// Looks up each key in the range `[first, last)`, writing an iterator
+    /// to it, or `this->end()` if not found, to `out`. Returns `out` past
+    /// the last iterator written.
+    template <class ForwardIt, class OutputIt>
+    OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = make_iterator_(
+                                         lookup_(hash_code, key));
+                             });
+        return out;
+    }
+
+    /// Writes whether each key in the range `[first, last)` is mapped by
+    /// this hash table to `out`, batching the lookups like `find_many`.
+    /// Returns `out` past the last result written.
+    template <class ForwardIt, class OutputIt>
+    OutputIt member_many(ForwardIt first, ForwardIt last, OutputIt out) const
+    {
+        for_each_prefetched_(first, last,
+                             [&](size_t hash_code, const auto& key) {
+                                 *out++ = lookup_(hash_code, key) !=
+                                          std::nullopt;
+                             });
+        return out;
+    }
+
+    /// Calls `fn` on a view of the element whose key is `key`, if there is
+    /// one, and returns whether there was.
+    ///
+    /// This locks the element once, both to compare its key and to lend it
+    /// to `fn`, whereas `find` and then dereferencing locks it twice.
+    template <class KeyLike = key_type, class Fn>
+    bool with(const KeyLike& key, Fn&& fn)
+    {
+        return with_hashed_(*this, hash_(key), key, fn);
+    }
+
+    /// Calls `fn` on a const view of the element whose key is `key`, if
+    /// there is one, and returns whether there was.
+    template <class KeyLike = key_type, class Fn>
+    bool with(const KeyLike& key, Fn&& fn) const
+    {
+        return with_hashed_(*this, hash_(key), key, fn);
+    }
+
+    /// Calls `fn` on a view of each live element, locking each element
+    /// once.
+    ///
+    /// If `fn` returns a value, returning `false` stops the visit early.
+    /// Returns whether every live element was visited.
+    template <class Fn>
+    bool for_each_live(Fn&& fn)
+    {
+        return for_each_live_(*this, fn);
+    }
+
+    /// Calls `fn` on a const view of each live element, locking each
+    /// element once.
+    ///
+    /// If `fn` returns a value, returning `false` stops the visit early.
+    /// Returns whether every live element was visited.
+    template <class Fn>
+    bool for_each_live(Fn&& fn) const
+    {
+        return for_each_live_(*this, fn);
+    }
+
+    /// Returns an iterator to the beginning of the hash table.
+    iterator begin()
+    {
+        return make_iterator_({0});
+    }
+
+    /// Returns an iterator past the end of the hash table.
+    iterator end()
+    {
+        return make_iterator_(std::nullopt);
+    }
+
+    /// Returns a constant iterator to the beginning of the hash table.
+    const_iterator begin() const
+    {
+        return cbegin();
+    }
+
+    /// Returns a constant iterator past the end of the hash table.
+    const_iterator end() const
+    {
+        return cend();
+    }
+
+    /// Returns a constant iterator to the beginning of the hash table.
+    const_iterator cbegin() const
+    {
+        return make_iterator_({0});
+    }
+
+    /// Returns a constant iterator past the end of the hash table.
+    const_iterator cend() const
+    {
+        return make_iterator_(std::nullopt);
+    }
+
+private:
+    iterator make_iterator_(std::optional<size_t> bucket_index)
+    {
+        if (!bucket_index)
+            return {ctrl_.begin() + bucket_count(), buckets_.end()};
+
+        return {ctrl_.begin() + *bucket_index,
+                buckets_.begin() + *bucket_index,
+                buckets_.end()};
+    }
+
+    const_iterator make_iterator_(std::optional<size_t> bucket_index) const
+    {
+        if (!bucket_index)
+            return {ctrl_.begin() + bucket_count(), buckets_.end()};
+
+        return {ctrl_.begin() + *bucket_index,
+                buckets_.begin() + *bucket_index,
+                buckets_.end()};
+    }
+
+protected:
+    /// Given a bucket, which must be uninitialized emplaces the value in
+    /// it. The caller is responsible for marking it full.
+    template <class... Args>
+    void construct_bucket_(Bucket& bucket, Args&&... args)
+    {
+        std::allocator_traits<weak_value_allocator_type>::construct(
+                weak_value_allocator_,
+                &bucket.value_,
+                std::forward<Args>(args)...);
+    }
+
+    /// Expects to call exactly one of the parameters `on_uninit`, `on_init`,
+    /// and `on_found`, which will (re-)initialize the bucket with the given key.
+    ///
+    /// The key may be anything that the hasher and key equality accept, so
+    /// callers can put off building a `key_type` until `on_uninit` or
+    /// `on_init` needs one.
+    template <class KeyLike, class OnUninit, class OnInit, class OnFound>
+    void insert_helper_(const KeyLike& key,
+                        OnUninit on_uninit, OnInit on_init, OnFound on_found)
+    {
+        insert_helper_(hash_(key), key, on_uninit, on_init, on_found);
+    }
+
+    /// Returns an iterator to a bucket that `insert_helper_` has just
+    /// passed to one of its callbacks.
+    iterator iterator_to_(Bucket& bucket)
+    {
+        return make_iterator_(size_t(&bucket - &buckets_[0]));
+    }
+
+private:
+    hasher hasher_;
+    key_equal equal_;
+    bucket_allocator_type bucket_allocator_;
+    weak_value_allocator_type weak_value_allocator_;
+    ctrl_allocator_type ctrl_allocator_;
+    float max_load_factor_;
+    float min_load_factor_;
+
+    // The control bytes: one per bucket, followed by copies of the first
+    // `group::width - 1`, so that a group may be loaded starting at any
+    // bucket without wrapping around.
+    ctrl_vector_t ctrl_;
+    vector_t buckets_;
+    // Full buckets, including expired ones.
+    size_t size_;
+    // Tombstones.
+    size_t deleted_;
+    // The largest `size_ + deleted_` allowed before rehashing.
+    size_t growth_limit_;
+    // Where `sweep_some` resumes, and how many buckets it has visited since
+    // the table was last resized.
+    size_t sweep_cursor_;
+    size_t swept_since_resize_;
+    // The most buckets asked for through the constructor or `reserve()`,
+    // which automatic shrinking stays at or above.
+    size_t reserved_bucket_count_;
+
+    static size_t capacity_for_(size_t requested)
+    {
+        if (requested == 0) return 0;
+        return power_of_two_indexing::bucket_count(
+                std::max(requested, size_t(group::width)));
+    }
+
+    static size_t ctrl_size_(size_t capacity)
+    {
+        return capacity == 0? 0 : capacity + group::width - 1;
+    }
+
+    size_t capacity_to_growth_(size_t capacity) const
+    {
+        if (capacity == 0) return 0;
+        // Always leave at least one empty bucket so that probing stops.
+        return std::min(capacity - 1, size_t(capacity * max_load_factor_));
+    }
+
+    size_t min_bucket_count_() const noexcept
+    {
+        return size_t(size() / max_load_factor()) + 1;
+    }
+
+    size_t mask_() const
+    {
+        return bucket_count() - 1;
+    }
+
+    void init_ctrl_()
+    {
+        for (auto& ctrl : ctrl_) {
+            ctrl = detail::ctrl_empty;
+        }
+
+        deleted_ = 0;
+        growth_limit_ = capacity_to_growth_(bucket_count());
+    }
+
+    void set_ctrl_(size_t index, ctrl_t ctrl)
+    {
+        ctrl_[index] = ctrl;
+        if (index < group::width - 1)
+            ctrl_[bucket_count() + index] = ctrl;
+    }
+
+    template <class KeyLike>
+    size_t hash_(const KeyLike& key) const
+    {
+        return power_of_two_indexing::mix(hasher_(key));
+    }
+
+    // The part of the hash code that chooses where probing starts.
+    static size_t h1_(size_t hash_code)
+    {
+        return hash_code >> 7;
+    }
+
+    // The part of the hash code that is stored in the control byte.
+    static ctrl_t h2_(size_t hash_code)
+    {
+        return ctrl_t(hash_code & 0x7F);
+    }
+
+    // Probing visits groups at triangular offsets from the starting
+    // position, which covers every group when the capacity is a power of
+    // two.
+    size_t probe_start_(size_t hash_code) const
+    {
+        return h1_(hash_code) & mask_();
+    }
+
+    size_t probe_next_(size_t pos, size_t& step) const
+    {
+        step += group::width;
+        return (pos + step) & mask_();
+    }
+
+    template <class KeyLike>
+    std::optional<size_t> lookup_(const KeyLike& key) const
+    {
+        return lookup_(hash_(key), key);
+    }
+
+    /// PRECONDITION: hash_code == hash_(key)
+    template <class KeyLike>
+    std::optional<size_t> lookup_(size_t hash_code, const KeyLike& key) const
+    {
+        if (bucket_count() == 0) return std::nullopt;
+
+        size_t pos = probe_start_(hash_code);
+        size_t step = 0;
+
+        for (;;) {
+            group g(&ctrl_[pos]);
+
+            for (auto matches = g.match(h2_(hash_code)); matches; ) {
+                size_t index = (pos + matches.pop()) & mask_();
+                const Bucket& bucket = buckets_[index];
+
+                if (hash_code == bucket.hash_code_) {
+                    const_view_value_type bucket_value_locked =
+                            bucket.value_.lock();
+                    if (const key_type* bucket_key =
+                            weak_trait::key(bucket_value_locked))
+                        if (equal_(key, *bucket_key))
+                            return {index};
+                }
+            }
+
+            if (g.match_empty())
+                return std::nullopt;
+
+            pos = probe_next_(pos, step);
+        }
+    }
+
+    // Probes like `lookup_`, but keeps the lock it compares keys with, so
+    // that `fn` gets the view without locking again.
+    template <class Self, class KeyLike, class Fn>
+    static bool with_hashed_(Self& self, size_t hash_code,
+                             const KeyLike& key, Fn& fn)
+    {
+        if (self.bucket_count() == 0) return false;
+
+        size_t pos = self.probe_start_(hash_code);
+        size_t step = 0;
+
+        for (;;) {
+            group g(&self.ctrl_[pos]);
+
+            for (auto matches = g.match(h2_(hash_code)); matches; ) {
+                size_t index = (pos + matches.pop()) & self.mask_();
+                auto& bucket = self.buckets_[index];
+
+                if (hash_code == bucket.hash_code_) {
+                    auto view = bucket.value_.lock();
+                    if (const key_type* bucket_key = weak_trait::key(view))
+                        if (self.equal_(key, *bucket_key)) {
+                            if (!weak_trait::live(view)) return false;
+                            fn(std::as_const(view));
+                            return true;
+                        }
+                }
+            }
+
+            if (g.match_empty())
+                return false;
+
+            pos = self.probe_next_(pos, step);
+        }
+    }
+
+    template <class Self, class Fn>
+    static bool for_each_live_(Self& self, Fn& fn)
+    {
+        for (size_t index = 0; index < self.bucket_count(); ++index) {
+            if (!detail::ctrl_is_full(self.ctrl_[index])) continue;
+
+            auto view = self.buckets_[index].value_.lock();
+            if (weak_trait::live(view) &&
+                    !detail::visit_and_continue(fn, std::as_const(view)))
+                return false;
+        }
+
+        return true;
+    }
+
+    /// The first empty or deleted bucket in the probe sequence for
+    /// `hash_code`.
+    size_t find_first_non_full_(size_t hash_code) const
+    {
+        size_t pos = probe_start_(hash_code);
+        size_t step = 0;
+
+        for (;;) {
+            group g(&ctrl_[pos]);
+
+            if (auto available = g.match_empty_or_deleted())
+                return (pos + available.pop()) & mask_();
+
+            pos = probe_next_(pos, step);
+        }
+    }
+
+    /// Copies the elements of `other` into this table, which must be empty
+    /// and have the same hasher, reusing their stored hash codes instead of
+    /// hashing their keys again.
+    ///
+    /// With the same capacity, this copies the control bytes and buckets
+    /// one for one, tombstones and expired elements and all. Otherwise it
+    /// places each live element without locking it, since the keys are
+    /// known to be distinct.
+    ///
+    /// PRECONDITION: size_ == 0
+    void copy_from_(const weak_swiss_table_base& other)
+    {
+        if (bucket_count() == other.bucket_count()) {
+            for (size_t i = 0; i < ctrl_.size(); ++i)
+                ctrl_[i] = other.ctrl_[i];
+
+            for (size_t i = 0; i < bucket_count(); ++i) {
+                if (!detail::ctrl_is_full(ctrl_[i])) continue;
+
+                construct_bucket_(buckets_[i], other.buckets_[i].value_);
+                buckets_[i].hash_code_ = other.buckets_[i].hash_code_;
+            }
+
+            size_ = other.size_;
+            deleted_ = other.deleted_;
+        } else {
+            reserve_for_insert_(other.size());
+
+            for (size_t i = 0; i < other.bucket_count(); ++i) {
+                if (!detail::ctrl_is_full(other.ctrl_[i])) continue;
+
+                const Bucket& from = other.buckets_[i];
+                if (from.value_.expired()) continue;
+
+                size_t index = find_first_non_full_(from.hash_code_);
+                construct_bucket_(buckets_[index], from.value_);
+                buckets_[index].hash_code_ = from.hash_code_;
+                set_ctrl_(index, h2_(from.hash_code_));
+                ++size_;
+            }
+        }
+    }
+
+    /// Rehashes, if need be, so that `count` more elements fit under the
+    /// growth limit.
+    void reserve_for_insert_(size_t count)
+    {
+        auto fits = [&] { return size_ + deleted_ + count <= growth_limit_; };
+
+        if (!fits()) {
+            sweep_before_resize_();
+            if (!fits())
+                resize_(size_t((size_ + count) / max_load_factor()) + 1);
+        }
+    }
+
+    /// Starts loading the control bytes and bucket where probing for
+    /// `hash_code` starts into cache.
+    void prefetch_probe_start_(size_t hash_code) const
+    {
+        if (bucket_count() != 0) {
+            size_t pos = probe_start_(hash_code);
+            detail::prefetch(&ctrl_[pos]);
+            detail::prefetch(&buckets_[pos]);
+        }
+    }
+
+    /// Inserts in batches, hashing and prefetching each batch before
+    /// probing for any of it.
+    template <typename InputIter>
+    void insert_batched_(InputIter start, InputIter limit)
+    {
+        std::vector<strong_value_type> values;
+        std::array<size_t, batch_size_> hash_codes;
+        values.reserve(batch_size_);
+
+        while (start != limit) {
+            values.clear();
+            for ( ; start != limit && values.size() < batch_size_;
+                  ++start)
+                values.emplace_back(*start);
+
+            for (size_t i = 0; i < values.size(); ++i) {
+                hash_codes[i] = hash_(weak_trait::strong_key(values[i]));
+                prefetch_probe_start_(hash_codes[i]);
+            }
+
+            for (size_t i = 0; i < values.size(); ++i)
+                insert_(hash_codes[i], std::move(values[i]));
+        }
+    }
+
+    /// Calls `visit(hash_code, key)` for each key in the range, a batch at
+    /// a time: it hashes the whole batch and prefetches where the probes
+    /// start, and only then visits the keys of the batch.
+    template <class ForwardIt, class Visit>
+    void for_each_prefetched_(ForwardIt first, ForwardIt last,
+                              Visit visit) const
+    {
+        std::array<size_t, batch_size_> hash_codes;
+
+        while (first != last) {
+            ForwardIt batch = first;
+            size_t count = 0;
+
+            for ( ; first != last && count < batch_size_; ++first, ++count) {
+                hash_codes[count] = hash_(*first);
+                prefetch_probe_start_(hash_codes[count]);
+            }
+
+            for (size_t i = 0; i < count; ++i, ++batch)
+                visit(hash_codes[i], *batch);
+        }
+    }
+
+    void insert_(size_t hash_code, const strong_value_type& value)
+    {
+        insert_helper_(hash_code, weak_trait::strong_key(value),
+                       [&](Bucket& bucket) {
+                           construct_bucket_(bucket, value);
+                       },
+                       [&](Bucket& bucket) {
+                           bucket.value_ = value;
+                       },
+                       [&](Bucket& bucket) {
+                           bucket.value_ = value;
+                       });
+    }
+
+    void insert_(size_t hash_code, strong_value_type&& value)
+    {
+        insert_helper_(hash_code, weak_trait::strong_key(value),
+                       [&](Bucket& bucket) {
+                           construct_bucket_(bucket, std::move(value));
+                       },
+                       [&](Bucket& bucket) {
+                           bucket.value_ = std::move(value);
+                       },
+                       [&](Bucket& bucket) {
+                           bucket.value_ = std::move(value);
+                       });
+    }
+
+    /// Expects to call exactly one of the parameters `on_uninit`, `on_init`,
+    /// and `on_found`, which will (re-)initialize the bucket with the given key.
+    ///
+    /// PRECONDITION: hash_code == hash_(key)
+    template <class KeyLike, class OnUninit, class OnInit, class OnFound>
+    void insert_helper_(size_t hash_code, const KeyLike& key,
+                        OnUninit on_uninit, OnInit on_init, OnFound on_found)
+    {
+        // An expired bucket with the same hash code, which is probably the
+        // previous incarnation of this key, and is reused if the key isn't
+        // found.
+        std::optional<size_t> expired_index;
+
+        if (bucket_count() != 0) {
+            size_t pos = probe_start_(hash_code);
+            size_t step = 0;
+
+            for (;;) {
+                group g(&ctrl_[pos]);
+
+                for (auto matches = g.match(h2_(hash_code)); matches; ) {
+                    size_t index = (pos + matches.pop()) & mask_();
+                    Bucket& bucket = buckets_[index];
+                    if (hash_code != bucket.hash_code_) continue;
+
+                    const_view_value_type bucket_locked = bucket.value_.lock();
+                    if (const key_type* bucket_key =
+                            weak_trait::key(bucket_locked)) {
+                        if (equal_(key, *bucket_key)) {
+                            on_found(bucket);
+                            return;
+                        }
+                    } else if (!expired_index) {
+                        expired_index = index;
+                    }
+                }
+
+                if (g.match_empty()) break;
+
+                pos = probe_next_(pos, step);
+            }
+        }
+
+        if (expired_index) {
+            on_init(buckets_[*expired_index]);
+            return;
+        }
+
+        size_t index = bucket_count() == 0? 0
+                     : find_first_non_full_(hash_code);
+
+        if (bucket_count() == 0 ||
+                (ctrl_[index] == detail::ctrl_empty &&
+                 size_ + deleted_ >= growth_limit_)) {
+            grow_();
+            index = find_first_non_full_(hash_code);
+        }
+
+        if (ctrl_[index] == detail::ctrl_deleted) --deleted_;
+
+        Bucket& bucket = buckets_[index];
+        on_uninit(bucket);
+        bucket.hash_code_ = hash_code;
+        set_ctrl_(index, h2_(hash_code));
+        ++size_;
+    }
+
+    /// Erases the bucket at `index`, leaving a tombstone unless no probe
+    /// sequence can have passed over it.
+    void erase_index_(size_t index)
+    {
+        destroy_bucket_(buckets_[index]);
+        release_ctrl_(index);
+    }
+
+    /// Frees up a bucket whose element has been destroyed.
+    void release_ctrl_(size_t index)
+    {
+        --size_;
+
+        // If some run of `group::width` control bytes containing this one
+        // never filled up then probing always stopped before passing it,
+        // so it can go straight back to empty.
+        size_t index_before = (index - group::width) & mask_();
+        auto empty_after = group(&ctrl_[index]).match_empty();
+        auto empty_before = group(&ctrl_[index_before]).match_empty();
+        bool was_never_full =
+                empty_before && empty_after &&
+                empty_after.trailing_zeros() + empty_before.leading_zeros()
+                        < group::width;
+
+        if (was_never_full) {
+            set_ctrl_(index, detail::ctrl_empty);
+        } else {
+            set_ctrl_(index, detail::ctrl_deleted);
+            ++deleted_;
+        }
+    }
+
+    /// Makes room to insert: first sweeps out expired elements, and then
+    /// rehashes, either at the same capacity if that frees enough room by
+    /// dropping tombstones, or at double capacity.
+    void grow_()
+    {
+        sweep_before_resize_();
+
+        size_t capacity = bucket_count();
+        if (capacity != 0 && size_ < capacity_to_growth_(capacity) / 2)
+            resize_(capacity);
+        else
+            resize_(std::max(2 * capacity, size_t(default_bucket_count)));
+    }
+
+    /// Removes expired elements ahead of a resize, unless `sweep_some` has
+    /// already been all the way around since the last one.
+    void sweep_before_resize_()
+    {
+        if (swept_since_resize_ < bucket_count())
+            remove_expired_();
+    }
+
+    void remove_expired_()
+    {
+        for (size_t i = 0; i < bucket_count(); ++i) {
+            if (detail::ctrl_is_full(ctrl_[i]) &&
+                    buckets_[i].value_.expired()) {
+                erase_index_(i);
+            }
+        }
+    }
+
+    /// Shrinks to half the maximum load factor if we've fallen below the
+    /// minimum.
+    void maybe_shrink_()
+    {
+        if (bucket_count() <= default_bucket_count ||
+                load_factor() >= min_load_factor())
+            return;
+
+        size_t new_bucket_count =
+                std::max(size_t(2 * size() / max_load_factor()) + 1,
+                         reserved_bucket_count_);
+        if (capacity_for_(new_bucket_count) < bucket_count())
+            resize_(new_bucket_count);
+    }
+
+    void resize_(size_t new_bucket_count)
+    {
+        // Enough buckets that the live elements don't exceed the growth
+        // limit.
+        size_t capacity = capacity_for_(std::max(new_bucket_count, size_t(1)));
+        while (capacity_to_growth_(capacity) <= size_)
+            capacity = capacity_for_(2 * capacity);
+
+        using std::swap;
+        ctrl_vector_t old_ctrl(ctrl_size_(capacity), ctrl_allocator_);
+        vector_t old_buckets(capacity, bucket_allocator_);
+        swap(old_ctrl, ctrl_);
+        swap(old_buckets, buckets_);
+        size_ = 0;
+        sweep_cursor_ = 0;
+        swept_since_resize_ = 0;
+        init_ctrl_();
+
+        for (size_t i = 0; i < old_buckets.size(); ++i) {
+            if (!detail::ctrl_is_full(old_ctrl[i])) continue;
+
+            Bucket& old_bucket = old_buckets[i];
+            if (!old_bucket.value_.expired()) {
+                size_t index = find_first_non_full_(old_bucket.hash_code_);
+                Bucket& bucket = buckets_[index];
+                construct_bucket_(bucket, std::move(old_bucket.value_));
+                bucket.hash_code_ = old_bucket.hash_code_;
+                set_ctrl_(index, h2_(bucket.hash_code_));
+                ++size_;
+            }
+
+            destroy_bucket_(old_bucket);
+        }
+    }
+
+    void destroy_bucket_(Bucket& bucket)
+    {
+        std::allocator_traits<weak_value_allocator_type>::destroy(
+                weak_value_allocator_,
+                &bucket.value_);
+    }
+};
+
+/// An iterator over the values of the hash table.
+///
+/// This iterator is invalidated by any operation that changes the hash
+/// table, including a shared pointer expiring.
+///
+/// The iterator locks each element once as it arrives there and holds on
+/// to the result, so the element it points at stays alive until it moves
+/// on.
+///
+/// This iterator may allow modifying the values, but it does not allow
+/// modifying the keys, since that would destroy the hash invariant.
+template <
+        class T,
+        class Hash,
+        class KeyEqual,
+        class Allocator,
+        class Policy
+>
+class weak_swiss_table_base<T, Hash, KeyEqual, Allocator, Policy>::iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+private:
+    friend class weak_swiss_table_base;
+    friend class const_iterator;
+
+    using base_t = typename vector_t::iterator;
+    using ctrl_base_t = typename ctrl_vector_t::const_iterator;
+
+    iterator(ctrl_base_t ctrl, base_t start, base_t limit)
+            : ctrl_(ctrl), base_(start), limit_(limit)
+    {
+        find_next_();
+    }
+
+    // An end iterator, which has nothing to look for.
+    iterator(ctrl_base_t ctrl, base_t limit)
+            : ctrl_(ctrl), base_(limit), limit_(limit)
+    { }
+
+public:
+    /// Provides a pointer view of the iterator.
+    const view_value_type* operator->() const
+    {
+        return view_.operator->();
+    }
+
+    /// Returns the value indicated by the iterator, as locked when the
+    /// iterator arrived at it.
+    const view_value_type& operator*() const
+    {
+        return *view_;
+    }
+
+    /// Advances the iterator.
+    iterator& operator++()
+    {
+        ++ctrl_;
+        ++base_;
+        find_next_();
+        return *this;
+    }
+
+    /// Advances the iterator.
+    iterator operator++(int)
+    {
+        auto old = *this;
+        ++*this;
+        return old;
+    }
+
+    /// Iterator equality.
+    bool operator==(const iterator& other) const
+    {
+        return base_ == other.base_;
+    }
+
+    /// Iterator disequality.
+    bool operator!=(const iterator& other) const
+    {
+        return base_ != other.base_;
+    }
+
+private:
+    // Invariant: if base_ != limit_ then *ctrl_ is full and view_ holds
+    // base_'s value, locked.
+    ctrl_base_t ctrl_;
+    base_t base_;
+    base_t limit_;
+    detail::view_cache<view_value_type> view_;
+
+    // Locks each full bucket once, stopping at the first live one.
+    void find_next_()
+    {
+        for (; base_ != limit_; ++ctrl_, ++base_) {
+            if (!detail::ctrl_is_full(*ctrl_)) continue;
+
+            view_value_type view = base_->value_.lock();
+            if (weak_trait::live(view)) {
+                view_.emplace(std::move(view));
+                return;
+            }
+        }
+
+        view_.reset();
+    }
+};
+
+/// A constant iterator over the values of the hash table.
+///
+/// This iterator is invalidated by any operation that changes the hash
+/// table, including a shared pointer expiring.
+///
+/// Like `iterator`, it keeps the element it points at alive.
+template <
+        class T,
+        class Hash,
+        class KeyEqual,
+        class Allocator,
+        class Policy
+>
+class weak_swiss_table_base<T, Hash, KeyEqual, Allocator, Policy>::const_iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = const T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+private:
+    friend class weak_swiss_table_base;
+
+    using base_t = typename vector_t::const_iterator;
+    using ctrl_base_t = typename ctrl_vector_t::const_iterator;
+
+    const_iterator(ctrl_base_t ctrl, base_t start, base_t limit)
+            : ctrl_(ctrl), base_(start), limit_(limit)
+    {
+        find_next_();
+    }
+
+    // An end iterator, which has nothing to look for.
+    const_iterator(ctrl_base_t ctrl, base_t limit)
+            : ctrl_(ctrl), base_(limit), limit_(limit)
+    { }
+
+public:
+    /// Implicit conversion from `iterator` to `const_iterator`.
+    const_iterator(iterator other)
+            : ctrl_(other.ctrl_), base_(other.base_), limit_(other.limit_)
+            , view_(other.view_)
+    { }
+
+    /// Provides a pointer view of the iterator.
+    const const_view_value_type* operator->() const
+    {
+        return view_.operator->();
+    }
+
+    /// Returns the value indicated by the iterator, as locked when the
+    /// iterator arrived at it.
+    const const_view_value_type& operator*() const
+    {
+        return *view_;
+    }
+
+    /// Advances the iterator.
+    const_iterator& operator++()
+    {
+        ++ctrl_;
+        ++base_;
+        find_next_();
+        return *this;
+    }
+
+    /// Advances the iterator.
+    const_iterator operator++(int)
+    {
+        auto old = *this;
+        ++*this;
+        return old;
+    }
+
+    /// Iterator equality.
+    bool operator==(const const_iterator& other) const
+    {
+        return base_ == other.base_;
+    }
+
+    /// Iterator disequality.
+    bool operator!=(const const_iterator& other) const
+    {
+        return base_ != other.base_;
+    }
+
+private:
+    // Invariant: if base_ != limit_ then *ctrl_ is full and view_ holds
+    // base_'s value, locked.
+    ctrl_base_t ctrl_;
+    base_t base_;
+    base_t limit_;
+    detail::view_cache<const_view_value_type> view_;
+
+    // Locks each full bucket once, stopping at the first live one.
+    void find_next_()
+    {
+        for (; base_ != limit_; ++ctrl_, ++base_) {
+            if (!detail::ctrl_is_full(*ctrl_)) continue;
+
+            const_view_value_type view = base_->value_.lock();
+            if (weak_trait::live(view)) {
+                view_.emplace(std::move(view));
+                return;
+            }
+        }
+
+        view_.reset();
+    }
+};
+
+/// Swaps the contents of two weak hash tables in constant time.
+template <class T, class Hash, class KeyEqual, class Allocator, class Policy>
+void swap(weak_swiss_table_base<T, Hash, KeyEqual, Allocator, Policy>& a,
+          weak_swiss_table_base<T, Hash, KeyEqual, Allocator, Policy>& b)
+{
+    a.swap(b);
+}
+
+} // end namespace weak
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "table_stats.h"
+
+#include <climits>
+#include <cstddef>
+#include <memory>
+
+namespace weak {
+
+template <class T, class Hash, class KeyEqual, class Allocator, class Policy>
+class weak_hash_table_base;
+
+template <class T, class Hash, class KeyEqual, class Allocator, class Policy>
+class weak_swiss_table_base;
+
+/// Maps hash codes to buckets by taking the remainder modulo the bucket
+/// count.
+///
+/// This works with any bucket count and uses hash codes as given, but it
+/// pays for an integer division every time it computes a home bucket.
+struct modulo_indexing
+{
+    /// Finalizes a hash code from the user's hasher before it is stored.
+    static size_t mix(size_t hash_code) noexcept
+    {
+        return hash_code;
+    }
+
+    /// The actual number of buckets to allocate when `requested` are asked
+    /// for.
+    static size_t bucket_count(size_t requested) noexcept
+    {
+        return requested;
+    }
+
+    /// The home bucket of a (mixed) hash code.
+    ///
+    /// *PRECONDITION*: `bucket_count > 0`
+    static size_t bucket(size_t hash_code, size_t bucket_count) noexcept
+    {
+        return hash_code % bucket_count;
+    }
+
+    /// The bucket after `pos`, wrapping around at the end.
+    static size_t next(size_t pos, size_t bucket_count) noexcept
+    {
+        return pos + 1 == bucket_count? 0 : pos + 1;
+    }
+
+    /// How far `actual` is from `preferred`, going forward and wrapping
+    /// around at the end.
+    static size_t distance(size_t actual, size_t preferred,
+                           size_t bucket_count) noexcept
+    {
+        if (actual >= preferred)
+            return actual - preferred;
+        else
+            return actual + bucket_count - preferred;
+    }
+};
+
+/// Keeps bucket counts at powers of two, so that finding a home bucket and
+/// wrapping around are both a mask rather than a division.
+///
+/// Because masking only looks at the low bits of the hash code, hash codes
+/// are first run through a finalizer, so that weak hashers such as the
+/// identity `std::hash<int>` or pointer hashes still spread over the table.
+struct power_of_two_indexing
+{
+    /// Finalizes a hash code from the user's hasher before it is stored.
+    ///
+    /// This is the MurmurHash3 finalizer for the width of `size_t`.
+    static size_t mix(size_t hash_code) noexcept
+    {
+        if constexpr (sizeof(size_t) * CHAR_BIT >= 64) {
+            hash_code ^= hash_code >> 33;
+            hash_code *= size_t(0xff51afd7ed558ccdULL);
+            hash_code ^= hash_code >> 33;
+            hash_code *= size_t(0xc4ceb9fe1a85ec53ULL);
+            hash_code ^= hash_code >> 33;
+        } else {
+            hash_code ^= hash_code >> 16;
+            hash_code *= size_t(0x85ebca6bUL);
+            hash_code ^= hash_code >> 13;
+            hash_code *= size_t(0xc2b2ae35UL);
+            hash_code ^= hash_code >> 16;
+        }
+
+        return hash_code;
+    }
+
+    /// Rounds `requested` up to a power of two (leaving 0 alone).
+    static size_t bucket_count(size_t requested) noexcept
+    {
+        size_t result = 1;
+        while (result < requested) result <<= 1;
+        return requested? result : 0;
+    }
+
+    /// The home bucket of a (mixed) hash code.
+    ///
+    /// *PRECONDITION*: `bucket_count` is a power of two
+    static size_t bucket(size_t hash_code, size_t bucket_count) noexcept
+    {
+        return hash_code & (bucket_count - 1);
+    }
+
+    /// The bucket after `pos`, wrapping around at the end.
+    static size_t next(size_t pos, size_t bucket_count) noexcept
+    {
+        return (pos + 1) & (bucket_count - 1);
+    }
+
+    /// How far `actual` is from `preferred`, going forward and wrapping
+    /// around at the end.
+    static size_t distance(size_t actual, size_t preferred,
+                           size_t bucket_count) noexcept
+    {
+        return (actual - preferred) & (bucket_count - 1);
+    }
+};
+
+/// What a table's last full sweep found, for a growth policy deciding
+/// whether another is worth it.
+struct sweep_history
+{
+    /// How many elements the last full sweep looked at, or 0 if there
+    /// hasn't been one.
+    size_t swept = 0;
+    /// How many of those it removed as expired.
+    size_t reclaimed = 0;
+    /// How many times the table has grown since then without sweeping.
+    size_t skipped = 0;
+};
+
+/// Grows by doubling, sweeping out expired elements first every time.
+///
+/// A growth policy decides what `weak_hash_table_base` does once it
+/// exceeds its maximum load factor:
+///
+///   - `sweep_before_growing(last)` says whether to remove expired
+///     elements first, given what the last full sweep found. (A table that
+///     `sweep_some` has covered since its last resize never sweeps again.)
+///
+///   - After such a sweep, the table still grows unless its load factor
+///     has come down to `sweep_target` times the maximum.
+///
+///   - `grow(bucket_count)` is the bucket count to grow to, which the table
+///     raises if need be to fit its elements.
+///
+///   - `min_bucket_count` is the fewest buckets that growing or shrinking
+///     on its own leaves. Constructors and `shrink_to_fit()` go by what
+///     they're asked for.
+struct doubling_growth
+{
+    static constexpr size_t min_bucket_count = 8;
+
+    static constexpr float sweep_target = 1;
+
+    static size_t grow(size_t bucket_count) noexcept
+    {
+        return 2 * bucket_count;
+    }
+
+    static bool sweep_before_growing(const sweep_history&) noexcept
+    {
+        return true;
+    }
+};
+
+/// Growth for tables whose elements rarely expire.
+///
+/// Full sweeps that find little to remove just delay growing, so this
+/// skips them until one would likely pay off: while the last one removed
+/// at least an eighth of the elements, or once the table has grown three
+/// times without one.
+struct low_churn_growth : doubling_growth
+{
+    static bool sweep_before_growing(const sweep_history& last) noexcept
+    {
+        return last.swept == 0 ||
+               8 * last.reclaimed >= last.swept ||
+               last.skipped >= 3;
+    }
+};
+
+/// Growth for tables where much of the table expires between growths.
+///
+/// This always sweeps first, but grows anyway unless the sweep freed at
+/// least a quarter of the maximum load. Otherwise a sweep that frees a few
+/// buckets leaves the table full again a few insertions later, to sweep
+/// the whole table again.
+struct high_churn_growth : doubling_growth
+{
+    static constexpr float sweep_target = 0.75;
+};
+
+/// Growth for tables that should stay small: it grows by half rather than
+/// doubling, and lets tables shrink down to two buckets.
+///
+/// With `power_of_two_indexing`, bucket counts still round up to powers of
+/// two, so this only changes the minimum.
+struct compact_growth : doubling_growth
+{
+    static constexpr size_t min_bucket_count = 2;
+
+    static size_t grow(size_t bucket_count) noexcept
+    {
+        return bucket_count + bucket_count / 2 + 1;
+    }
+};
+
+/// Selects `weak_hash_table_base`, an open-addressed Robin Hood table that
+/// keeps each bucket's metadata next to its element.
+struct robin_hood_engine
+{
+    template <class T, class Hash, class KeyEqual, class Allocator,
+              class Policy>
+    using table = weak_hash_table_base<T, Hash, KeyEqual, Allocator, Policy>;
+};
+
+/// Selects `weak_swiss_table_base`, which keeps a separate array of one-byte
+/// control tags and probes them a group at a time.
+///
+/// This engine does less than the Robin Hood one. It has no
+/// `make_tracked`, so its expired elements wait for a sweep. It also
+/// resizes all at once on the calling thread, so it has no
+/// `rehash_step()` or `resize_threads()`. It takes only the default
+/// `stats` and `growth` (see `default_table_policy`).
+struct swiss_engine
+{
+    template <class T, class Hash, class KeyEqual, class Allocator,
+              class Policy>
+    using table = weak_swiss_table_base<T, Hash, KeyEqual, Allocator, Policy>;
+};
+
+/// The policy used by the weak hash tables unless another is given.
+///
+/// A policy bundles the compile-time choices that a weak hash table makes
+/// beyond hashing, equality and allocation. To customize one choice, derive
+/// from this and override the corresponding member.
+struct default_table_policy
+{
+    /// How hash codes are mapped to buckets.
+    using indexing = modulo_indexing;
+
+    /// Which table implementation the derived tables (`weak_unordered_set`
+    /// and the maps) are built on. `weak_hash_table_base` itself is always
+    /// a Robin Hood table, whatever this says.
+    using engine = robin_hood_engine;
+
+    /// The weak pointers that the derived tables store, which determine the
+    /// strong pointers that they take and hand out. There must be a
+    /// `weak_traits` specialization for them.
+    template <class T>
+    using weak_pointer = std::weak_ptr<T>;
+
+    /// What `weak_hash_table_base` counts for `stats()`: nothing, or
+    /// everything in `table_stats` with `counting_table_stats`. The Swiss
+    /// engine keeps no stats, and takes only `no_table_stats`.
+    using stats = no_table_stats;
+
+    /// How `weak_hash_table_base` grows, and when it sweeps before
+    /// growing. The Swiss engine has its own rule, which also clears
+    /// tombstones, and takes only `doubling_growth`.
+    using growth = doubling_growth;
+};
+
+/// A policy for keeping power-of-two bucket counts.
+///
+/// This makes probing cheaper, at the cost of an extra hash finalization
+/// on each hash, and of up to twice the memory for a reserved size.
+struct power_of_two_policy : default_table_policy
+{
+    using indexing = power_of_two_indexing;
+};
+
+/// A policy for building the tables on `weak_swiss_table_base`.
+///
+/// That engine always uses power-of-two capacities and finalizes hashes
+/// itself, so it ignores `indexing`.
+struct swiss_policy : default_table_policy
+{
+    using engine = swiss_engine;
+};
+
+/// A policy for tables that count what they do, for tuning; see
+/// `weak_hash_table_base::stats()`.
+struct counting_policy : default_table_policy
+{
+    using stats = counting_table_stats;
+};
+
+/// The base class that `Policy` selects for a table of `T`s.
+template <class T, class Hash, class KeyEqual, class Allocator, class Policy>
+using weak_table_base_t = typename Policy::engine::template table<
+        T, Hash, KeyEqual, Allocator, Policy>;
+
+} // end namespace weak
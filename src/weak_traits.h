@@ -42,14 +42,23 @@ struct weak_traits
         return T::view(strong);
     }
 
-    /// Projects a key pointer from a `view_type`.
+    /// Projects a key pointer from a `view_type` or `const_view_type`.
     ///
     /// The result might be `nullptr`.
-    static const key_type* key(const_view_type& view)
+    template <class View>
+    static const key_type* key(const View& view)
     {
         return T::key(view);
     }
 
+    /// Does a `view_type` or `const_view_type` hold a live element? One
+    /// locked from an expired weak pointer doesn't.
+    template <class View>
+    static bool live(const View& view)
+    {
+        return T::live(view);
+    }
+
     /// Projects a key pointer from a `strong_type`.
     static const key_type& strong_key(const strong_type& strong) {
         return T::strong_key(strong);
@@ -73,7 +82,7 @@ struct weak_traits<std::weak_ptr<T>>
     using const_view_type = view_type;
     using key_type = T;
 
-    static const_view_type view(strong_type& strong)
+    static const_view_type view(const strong_type& strong)
     {
         return strong;
     }
@@ -83,6 +92,11 @@ struct weak_traits<std::weak_ptr<T>>
         return view.get();
     }
 
+    static bool live(const view_type& view)
+    {
+        return view != nullptr;
+    }
+
     static const key_type& strong_key(const strong_type& strong)
     {
         return *strong;
@@ -106,13 +120,18 @@ struct weak_traits<std::weak_ptr<const T>>
     static const_view_type view(const strong_type& strong)
     {
         return strong;
-
+    }
 
     static key_type* key(const_view_type& view)
     {
         return view? view.get() : nullptr;
     }
 
+    static bool live(const view_type& view)
+    {
+        return view != nullptr;
+    }
+
     static key_type& strong_key(const strong_type& strong)
     {
         return *strong;
@@ -135,6 +154,11 @@ struct by_ptr
     {
         return ptr.lock();
     }
+
+    bool expired() const
+    {
+        return ptr.expired();
+    }
 };
 
 template <class WeakPtr>
@@ -151,10 +175,14 @@ struct weak_traits<by_ptr<WeakPtr>>
         return weak_ptr_traits::view(strong);
     }
 
-    static const key_type* key(const_view_type& view) {
+    static const key_type* key(const const_view_type& view) {
         return &view;
     }
 
+    static bool live(const view_type& view) {
+        return weak_ptr_traits::live(view);
+    }
+
     static key_type strong_key(const strong_type& strong) {
         return weak_ptr_traits::view(strong);
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "weak_hash_table_base.h"
+#include "weak_swiss_table_base.h"
 #include "weak_traits.h"
 
 /// Namespace for weak pairs and hash tables.
@@ -14,30 +15,32 @@ template <
     class Key,
     class Hash = std::hash<Key>,
     class KeyEqual = std::equal_to<>,
-    class Allocator = std::allocator<Key>
+    class Allocator = std::allocator<Key>,
+    class Policy = default_table_policy
 >
 class weak_unordered_set :
-    public weak_hash_table_base<std::weak_ptr<const Key>,
-                                Hash, KeyEqual, Allocator>
+    public weak_table_base_t<typename Policy::template weak_pointer<const Key>,
+                             Hash, KeyEqual, Allocator, Policy>
 {
-    using BaseClass = weak_hash_table_base<std::weak_ptr<const Key>,
-                                           Hash, KeyEqual, Allocator>;
+    using BaseClass =
+        weak_table_base_t<typename Policy::template weak_pointer<const Key>,
+                          Hash, KeyEqual, Allocator, Policy>;
 public:
-    using BaseClass::weak_hash_table_base;
+    using BaseClass::BaseClass;
 };
 
 /// Swaps two `weak_unordered_set`s in constant time.
-template <class Key, class Hash, class KeyEqual, class Allocator>
-void swap(weak_unordered_set<Key, Hash, KeyEqual, Allocator>& a,
-          weak_unordered_set<Key, Hash, KeyEqual, Allocator>& b)
+template <class Key, class Hash, class KeyEqual, class Allocator, class Policy>
+void swap(weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& a,
+          weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& b)
 {
     a.swap(b);
 }
 
 /// Is `a` a subset of `b`?
-template <class Key, class Hash, class KeyEqual, class Allocator>
-bool subset(const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& a,
-            const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& b)
+template <class Key, class Hash, class KeyEqual, class Allocator, class Policy>
+bool subset(const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& a,
+            const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& b)
 {
     for (const auto& elem : a)
         if (!b.member(*elem)) return false;
@@ -46,17 +49,17 @@ bool subset(const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& a,
 }
 
 /// Equality for `weak_unordered_set`s.
-template <class Key, class Hash, class KeyEqual, class Allocator>
-bool operator==(const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& a,
-                const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& b)
+template <class Key, class Hash, class KeyEqual, class Allocator, class Policy>
+bool operator==(const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return subset(a, b) && subset(b, a);
 }
 
 /// Disequality for `weak_unordered_set`s.
-template <class Key, class Hash, class KeyEqual, class Allocator>
-bool operator!=(const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& a,
-                const weak_unordered_set<Key, Hash, KeyEqual, Allocator>& b)
+template <class Key, class Hash, class KeyEqual, class Allocator, class Policy>
+bool operator!=(const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_unordered_set<Key, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return !(a == b);
 }
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "weak_hash_table_base.h"
+#include "weak_swiss_table_base.h"
 #include "weak_traits.h"
 #include "weak_value_pair.h"
 
 #include <functional>
+#include <type_traits>
+#include <utility>
 
 namespace weak {
 
@@ -15,17 +18,27 @@ namespace weak {
 template<class Key, class T,
          class Hash = std::hash<Key>,
          class KeyEqual = std::equal_to<>,
-         class Allocator = std::allocator<weak_value_pair<Key, T>>
+         class Allocator = std::allocator<weak_value_pair<Key, T>>,
+         class Policy = default_table_policy
 >
 class weak_value_unordered_map
-        : public weak_hash_table_base<weak_value_pair<Key, T>,
-                                                 Hash, KeyEqual, Allocator>
+        : public weak_table_base_t<
+                weak_value_pair<Key, T,
+                                typename Policy::template weak_pointer<T>>,
+                Hash, KeyEqual, Allocator, Policy>
 {
-    using BaseClass = weak_hash_table_base<weak_value_pair<Key, T>,
-                                                      Hash, KeyEqual, Allocator>;
+    using BaseClass = weak_table_base_t<
+            weak_value_pair<Key, T,
+                            typename Policy::template weak_pointer<T>>,
+            Hash, KeyEqual, Allocator, Policy>;
     using Bucket = typename BaseClass::Bucket;
 public:
-    using BaseClass::weak_hash_table_base;
+    using typename BaseClass::iterator;
+
+    using BaseClass::BaseClass;
+
+    /// The strong pointers to values, `std::shared_ptr<T>` by default.
+    using value_pointer = typename BaseClass::weak_value_type::second_pointer;
 
     /// Proxy class returned by `operator[](const Key&)`.
     ///
@@ -50,26 +63,26 @@ public:
         }
 
         /// The proxy stands for a `shared_ptr`.
-        std::shared_ptr<T> operator->() const noexcept
+        value_pointer operator->() const noexcept
         {
             return value_ptr_;
         }
 
         /// The proxy is coercible to a `shared_ptr`.
-        operator std::shared_ptr<T>() const noexcept
+        operator value_pointer() const noexcept
         {
             return value_ptr_;
         }
 
         /// Assigning a `shared_ptr` to the proxy assigns into the map.
-        proxy& operator=(const std::shared_ptr<T>& value)
+        proxy& operator=(const value_pointer& value)
         {
             bucket_.value().second = value_ptr_ = value;
             return *this;
         }
 
         /// Assigning a `shared_ptr` to the proxy assigns into the map.
-        proxy& operator=(std::shared_ptr<T>&& value)
+        proxy& operator=(value_pointer&& value)
         {
             bucket_.value().second = value_ptr_ = std::move(value);
             return *this;
@@ -82,7 +95,7 @@ public:
         { }
 
         Bucket& bucket_;
-        std::shared_ptr<T> value_ptr_;
+        value_pointer value_ptr_;
 
         friend class weak_value_unordered_map;
     };
@@ -93,20 +106,24 @@ public:
     /// If the key doesn't exist then it is inserted and temporarily mapped
     /// to an expired pointer. However, assigning a `shared_ptr` to the proxy
     /// will stored the `shared_ptr` in the map instead.
-    proxy operator[](const Key& key)
+    ///
+    /// The key may be anything that the hasher and key equality accept. A
+    /// `Key` is only built from it when a bucket needs one.
+    template <class KeyLike = Key>
+    proxy operator[](const KeyLike& key)
     {
         Bucket* result_bucket;
 
         BaseClass::insert_helper_(
                 key,
                 [&](Bucket& bucket) {
-                    BaseClass::construct_bucket_(bucket, key,
-                                                 std::shared_ptr<T>{});
+                    BaseClass::construct_bucket_(bucket, make_key_(key),
+                                                 value_pointer{});
                     result_bucket = &bucket;
                 },
                 [&](Bucket& bucket) {
-                    bucket.value().first = key;
-                    bucket.value().second = std::shared_ptr<T>{};
+                    bucket.value().first = make_key_(key);
+                    bucket.value().second = value_pointer{};
                     result_bucket = &bucket;
                 },
                 [&](Bucket& bucket) {
@@ -115,12 +132,86 @@ public:
 
         return proxy(*result_bucket);
     }
+
+    /// Maps the given key to `value` unless it's already mapped to a live
+    /// value. Returns an iterator to the association and whether it was
+    /// inserted.
+    ///
+    /// As with `operator[]`, a `Key` is only built from `key` when a bucket
+    /// needs one.
+    template <class KeyLike = Key, class Value>
+    std::pair<iterator, bool> try_emplace(const KeyLike& key, Value&& value)
+    {
+        Bucket* result_bucket;
+        bool inserted = true;
+
+        BaseClass::insert_helper_(
+                key,
+                [&](Bucket& bucket) {
+                    BaseClass::construct_bucket_(bucket, make_key_(key),
+                                                 std::forward<Value>(value));
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    bucket.value().first = make_key_(key);
+                    bucket.value().second = std::forward<Value>(value);
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    inserted = false;
+                    result_bucket = &bucket;
+                });
+
+        return {BaseClass::iterator_to_(*result_bucket), inserted};
+    }
+
+    /// Maps the given key to `value`, replacing any value it already has.
+    /// Returns an iterator to the association and whether it was inserted.
+    template <class KeyLike = Key, class Value>
+    std::pair<iterator, bool> insert_or_assign(const KeyLike& key,
+                                               Value&& value)
+    {
+        Bucket* result_bucket;
+        bool inserted = true;
+
+        BaseClass::insert_helper_(
+                key,
+                [&](Bucket& bucket) {
+                    BaseClass::construct_bucket_(bucket, make_key_(key),
+                                                 std::forward<Value>(value));
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    bucket.value().first = make_key_(key);
+                    bucket.value().second = std::forward<Value>(value);
+                    result_bucket = &bucket;
+                },
+                [&](Bucket& bucket) {
+                    bucket.value().second = std::forward<Value>(value);
+                    inserted = false;
+                    result_bucket = &bucket;
+                });
+
+        return {BaseClass::iterator_to_(*result_bucket), inserted};
+    }
+
+private:
+    // A `Key` for a new bucket, without copying one that's already a `Key`.
+    template <class KeyLike>
+    static decltype(auto) make_key_(const KeyLike& key)
+    {
+        if constexpr (std::is_same_v<KeyLike, Key>)
+            return (key);
+        else
+            return Key(key);
+    }
 };
 
 /// Swaps two `weak_value_unordered_map`s in constant time.
-template<class Key, class T, class Hash, class KeyEqual, class Allocator>
-void swap(weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-          weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+template<class Key, class T, class Hash, class KeyEqual, class Allocator,
+         class Policy>
+void swap(weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+          weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     a.swap(b);
 }
@@ -131,10 +222,10 @@ void swap(weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
 /// according to `compare`. Function `compare` defaults to equality, but
 /// other relations are possible.
 template <class Key, class T, class Hash, class KeyEqual, class Allocator,
-          class TEqual = std::equal_to<>>
+          class Policy, class TEqual = std::equal_to<>>
 bool submap(
-        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b,
+        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b,
         TEqual compare = TEqual())
 {
     for (const auto& elem : a) {
@@ -147,26 +238,29 @@ bool submap(
 }
 
 /// Are the keys of `a` a subset of the keys of `b`?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
 bool keys_subset(
-        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+        const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
-    submap(a, b, [](const auto&, const auto&) { return true; });
+    return submap(a, b, [](const auto&, const auto&) { return true; });
 }
 
 /// Are the given maps equal?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
-bool operator==(const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-                const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
+bool operator==(const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return submap(a, b) && keys_subset(b, a);
 }
 
 /// Are the given maps unequal?
-template <class Key, class T, class Hash, class KeyEqual, class Allocator>
-bool operator!=(const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& a,
-                const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator>& b)
+template <class Key, class T, class Hash, class KeyEqual, class Allocator,
+          class Policy>
+bool operator!=(const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& a,
+                const weak_value_unordered_map<Key, T, Hash, KeyEqual, Allocator, Policy>& b)
 {
     return !(a == b);
 }
@@ -1,6 +1,7 @@
 #include "weak_traits.h"
 
 #include <memory>
+#include <utility>
 
 namespace weak {
 
@@ -32,6 +33,11 @@ struct weak_weak_pair
             : first(strong.first), second(strong.second)
     { }
 
+    /// Constructs a weak pair from a strong pair, moving from it.
+    weak_weak_pair(strong_type&& strong)
+            : first(std::move(strong.first)), second(std::move(strong.second))
+    { }
+
     /// Constructs a weak pair from the given key and value.
     template <class K, class V>
     weak_weak_pair(K&& key, V&& value)
@@ -61,12 +67,22 @@ struct weak_weak_pair
         return {strong.first, strong.second};
     }
 
-    /// Gets a pointer to the key from a view pair.
-    static const first_type* key(const_view_type& view)
+    /// Gets a pointer to the key from a view or const view pair.
+    template <class View>
+    static const first_type* key(const View& view)
     {
         return view.first.get();
     }
 
+    /// Does a view or const view pair hold a live element?
+    ///
+    /// A view of a weak-weak pair is live if it holds both components.
+    template <class View>
+    static bool live(const View& view)
+    {
+        return view.first != nullptr && view.second != nullptr;
+    }
+
     /// Gets a pointer to the key from a strong pair.
     static const first_type& strong_key(const strong_type& strong)
     {
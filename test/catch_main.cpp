@@ -1,2 +1,5 @@
 #define CATCH_CONFIG_MAIN
-#include <catch.hpp>
\ No newline at end of file
+// This version of Catch sizes its signal stack with SIGSTKSZ, which newer
+// glibc no longer defines as a constant.
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include <catch.hpp>
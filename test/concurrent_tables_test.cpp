@@ -0,0 +1,197 @@
+#include "concurrent_weak_unordered_set.h"
+#include "concurrent_weak_key_unordered_map.h"
+#include "read_mostly_weak_unordered_set.h"
+
+#include <catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace weak;
+
+TEST_CASE("concurrent_weak_unordered_set")
+{
+    concurrent_weak_unordered_set<int> set(5);
+    CHECK( set.shard_count() == 8 );
+
+    auto five = make_shared<const int>(5);
+    set.insert(five);
+    CHECK( set.member(5) );
+    CHECK( set.find(5) == five );
+    CHECK( set.find(6) == nullptr );
+
+    CHECK( set.get_or_insert(make_shared<const int>(5)) == five );
+    auto six = set.get_or_insert(6, [] { return make_shared<const int>(6); });
+    CHECK( *six == 6 );
+    CHECK( set.find(6) == six );
+
+    CHECK( set.erase(6) );
+    CHECK_FALSE( set.member(6) );
+
+    five = nullptr;
+    CHECK_FALSE( set.member(5) );
+    set.remove_expired();
+    CHECK( set.size() == 0 );
+}
+
+TEST_CASE("concurrent_weak_unordered_set interning from many threads")
+{
+    concurrent_weak_unordered_set<string, hash<string_view>> set;
+
+    const size_t thread_count = 8;
+    const int key_count = 2000;
+
+    // Each thread interns every key and keeps what it gets back, so all
+    // threads should end up holding the same pointers.
+    vector<vector<shared_ptr<const string>>> results(thread_count);
+    vector<thread> threads;
+
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < key_count; ++i) {
+                int k = int(t % 2 == 0? i : key_count - 1 - i);
+                string name = to_string(k);
+                results[t].push_back(set.get_or_insert(
+                        string_view(name),
+                        [&] { return make_shared<const string>(name); }));
+                if (k % 7 == 0) set.remove_expired_in_shard(k % set.shard_count());
+            }
+        });
+    }
+
+    for (auto& th : threads) th.join();
+
+    for (size_t t = 0; t < thread_count; ++t) {
+        for (int i = 0; i < key_count; ++i) {
+            int k = int(t % 2 == 0? i : key_count - 1 - i);
+            CHECK( *results[t][i] == to_string(k) );
+            CHECK( results[t][i] == set.find(string_view(to_string(k))) );
+        }
+    }
+
+    CHECK( set.size() == size_t(key_count) );
+}
+
+TEST_CASE("concurrent_weak_key_unordered_map")
+{
+    concurrent_weak_key_unordered_map<int, int> map;
+
+    vector<shared_ptr<const int>> keys;
+    for (int i = 0; i < 1000; ++i)
+        keys.push_back(make_shared<const int>(i));
+
+    // Catch's assertions aren't thread-safe, so the threads only count.
+    atomic<int> made{0}, wrong{0};
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                int value = map.get_or_insert(keys[i], [&] {
+                    ++made;
+                    return 2 * i;
+                });
+                if (value != 2 * i) ++wrong;
+            }
+        });
+    }
+
+    for (auto& th : threads) th.join();
+
+    CHECK( made == 1000 );
+    CHECK( wrong == 0 );
+    CHECK( map.find(10) == 20 );
+    CHECK( map.find(1000) == nullopt );
+
+    map.insert(keys[10], 11);
+    CHECK( map.find(10) == 11 );
+    CHECK( map.erase(10) );
+    CHECK_FALSE( map.member(10) );
+
+    keys.resize(500);
+    map.remove_expired();
+    CHECK( map.size() == 499 );
+}
+
+TEST_CASE("epoch_domain")
+{
+    struct flag_on_delete
+    {
+        bool& deleted;
+        ~flag_on_delete() { deleted = true; }
+    };
+
+    detail::epoch_domain domain;
+    bool first = false, second = false;
+
+    domain.retire(new flag_on_delete{first});
+    CHECK( first );
+
+    {
+        auto guard = domain.pin();
+        domain.retire(new flag_on_delete{second});
+        domain.reclaim();
+        CHECK_FALSE( second );
+    }
+
+    domain.reclaim();
+    CHECK( second );
+}
+
+TEST_CASE("read_mostly_weak_unordered_set")
+{
+    read_mostly_weak_unordered_set<int> set;
+
+    auto five = make_shared<const int>(5);
+    set.insert(five);
+    CHECK( set.find(5) == five );
+    CHECK( set.get_or_insert(make_shared<const int>(5)) == five );
+    CHECK_FALSE( set.member(6) );
+
+    vector<shared_ptr<const int>> more;
+    for (int i = 6; i < 100; ++i) more.push_back(make_shared<const int>(i));
+    set.insert(more.begin(), more.end());
+    CHECK( set.size() == 95 );
+
+    CHECK( set.erase(6) );
+    CHECK_FALSE( set.erase(6) );
+    CHECK_FALSE( set.member(6) );
+
+    more.clear();
+    CHECK( set.member(5) );
+    CHECK_FALSE( set.member(7) );
+    set.remove_expired();
+    CHECK( set.size() == 1 );
+
+    // Readers run while a writer interns keys one at a time.
+    const int key_count = 500;
+    vector<shared_ptr<const int>> keys;
+    for (int i = 0; i < key_count; ++i) keys.push_back(make_shared<const int>(i));
+
+    atomic<bool> done{false};
+    atomic<int> wrong{0};
+    vector<thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            while (!done) {
+                for (int i = 0; i < key_count; ++i) {
+                    auto found = set.find(i);
+                    if (found && *found != i) ++wrong;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < key_count; ++i) {
+        if (set.get_or_insert(keys[i]) != (i == 5? five : keys[i])) ++wrong;
+    }
+
+    done = true;
+    for (auto& th : readers) th.join();
+
+    CHECK( wrong == 0 );
+    CHECK( set.size() == size_t(key_count) );
+}
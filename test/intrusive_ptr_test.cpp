@@ -0,0 +1,110 @@
+#include "intrusive_ptr.h"
+#include "weak_unordered_set.h"
+#include "weak_key_unordered_map.h"
+#include "weak_value_unordered_map.h"
+#include "weak_weak_unordered_map.h"
+
+#include <catch.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace weak;
+
+namespace {
+
+struct counted
+{
+    static int live;
+
+    int value;
+
+    explicit counted(int v) : value(v) { ++live; }
+    ~counted() { --live; }
+};
+
+int counted::live = 0;
+
+}
+
+TEST_CASE("intrusive_ptr")
+{
+    intrusive_weak_ptr<const counted> weak;
+    CHECK( weak.expired() );
+    CHECK( weak.lock() == nullptr );
+
+    {
+        auto strong = make_intrusive<counted>(5);
+        CHECK( counted::live == 1 );
+        CHECK( strong->value == 5 );
+        CHECK( strong.use_count() == 1 );
+
+        intrusive_ptr<const counted> other = strong;
+        CHECK( other == strong );
+        CHECK( strong.use_count() == 2 );
+
+        weak = strong;
+        CHECK_FALSE( weak.expired() );
+        CHECK( weak.lock() == strong );
+        CHECK( strong.use_count() == 2 );
+    }
+
+    // Destroyed, though the weak pointer keeps the counts around.
+    CHECK( counted::live == 0 );
+    CHECK( weak.expired() );
+    CHECK( weak.lock() == nullptr );
+}
+
+TEST_CASE("intrusive weak_unordered_set")
+{
+    weak_unordered_set<string, hash<string>, equal_to<>,
+                       allocator<string>, intrusive_policy> set;
+
+    vector<intrusive_ptr<string>> holder;
+    for (int i = 0; i < 100; ++i) {
+        holder.push_back(make_intrusive<string>(to_string(i)));
+        set.insert(holder.back());
+    }
+
+    CHECK( set.size() == 100 );
+    CHECK( set.member("42") );
+    CHECK( *set.find("42") == holder[42] );
+
+    for (int i = 0; i < 100; i += 2) holder[i] = nullptr;
+
+    CHECK_FALSE( set.member("42") );
+    CHECK( set.member("43") );
+    set.remove_expired();
+    CHECK( set.size() == 50 );
+}
+
+TEST_CASE("intrusive maps")
+{
+    weak_key_unordered_map<string, int, hash<string>, equal_to<>,
+                           allocator<string>, intrusive_policy> key_map;
+    weak_value_unordered_map<string, int, hash<string>, equal_to<>,
+                             allocator<string>, intrusive_policy> value_map;
+    weak_weak_unordered_map<string, int, hash<string>, equal_to<>,
+                            allocator<string>, intrusive_policy> weak_map;
+
+    auto hello = make_intrusive<const string>("hello");
+    auto five = make_intrusive<int>(5);
+
+    key_map[hello] = 5;
+    value_map["hello"] = five;
+    weak_map[hello] = five;
+
+    CHECK( (*key_map.find("hello")).second == 5 );
+    CHECK( *value_map["hello"] == 5 );
+    CHECK( *weak_map[hello] == 5 );
+
+    five = nullptr;
+    CHECK( key_map.member("hello") );
+    CHECK_FALSE( value_map.member("hello") );
+    CHECK_FALSE( weak_map.member("hello") );
+
+    hello = nullptr;
+    CHECK_FALSE( key_map.member("hello") );
+}
@@ -0,0 +1,60 @@
+#include "local_ptr.h"
+
+#include <catch.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace weak;
+
+TEST_CASE("local_shared_ptr")
+{
+    local_weak_ptr<const string> weak;
+
+    {
+        auto strong = make_local_shared<string>("hello");
+        local_shared_ptr<const string> other = strong;
+        CHECK( strong.use_count() == 2 );
+
+        weak = other;
+        CHECK( *weak.lock() == "hello" );
+    }
+
+    CHECK( weak.expired() );
+    CHECK( weak.lock() == nullptr );
+}
+
+TEST_CASE("local tables")
+{
+    local::weak_unordered_set<int> set;
+    local::weak_key_unordered_map<int, string> key_map;
+    local::weak_value_unordered_map<string, int> value_map;
+
+    vector<local_shared_ptr<int>> holder;
+    for (int i = 0; i < 100; ++i) {
+        holder.push_back(make_local_shared<int>(i));
+        set.insert(holder.back());
+        key_map[holder.back()] = to_string(i);
+        value_map[to_string(i)] = holder.back();
+    }
+
+    CHECK( set.member(42) );
+    CHECK( (*key_map.find(42)).second == "42" );
+    CHECK( *value_map["42"] == 42 );
+
+    for (int i = 0; i < 100; i += 2) holder[i] = nullptr;
+
+    CHECK_FALSE( set.member(42) );
+    CHECK_FALSE( key_map.member(42) );
+    CHECK_FALSE( value_map.member("42") );
+    CHECK( set.member(43) );
+
+    set.remove_expired();
+    key_map.remove_expired();
+    value_map.remove_expired();
+    CHECK( set.size() == 50 );
+    CHECK( key_map.size() == 50 );
+    CHECK( value_map.size() == 50 );
+}
@@ -1,6 +1,7 @@
 #include "weak_weak_pair.h"
 #include "weak_key_pair.h"
 #include "weak_value_pair.h"
+#include "intrusive_ptr.h"
 
 #include <catch.hpp>
 #include <memory>
@@ -62,3 +63,28 @@ TEST_CASE("weak_pair")
     CHECK( pair.expired() );
 }
 
+
+TEST_CASE("intrusive pairs")
+{
+    auto hello = make_intrusive<const string>("hello");
+    auto world = make_intrusive<string>("world");
+
+    weak_key_pair<string, int, intrusive_weak_ptr<const string>>
+            key_pair{hello, 5};
+    weak_value_pair<int, string, intrusive_weak_ptr<string>>
+            value_pair{5, world};
+    weak_weak_pair<string, string, intrusive_weak_ptr<const string>,
+                   intrusive_weak_ptr<string>> weak_pair{hello, world};
+
+    CHECK( key_pair.lock().first == hello );
+    CHECK( value_pair.lock().second == world );
+    CHECK( weak_pair.lock().second == world );
+
+    world = nullptr;
+    CHECK_FALSE( key_pair.expired() );
+    CHECK( value_pair.expired() );
+    CHECK( weak_pair.expired() );
+
+    hello = nullptr;
+    CHECK( key_pair.expired() );
+}
@@ -3,10 +3,15 @@
 #include "weak_value_unordered_map.h"
 
 #include <catch.hpp>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 using namespace weak;
 using namespace std;
+using namespace std::literals;
 
 TEST_CASE("weak_key_unordered_map")
 {
@@ -26,6 +31,11 @@ TEST_CASE("weak_key_unordered_map")
     CHECK( map.find(5) != map.end() );
     CHECK( map[five] == 5 );
 
+    // Writing through `->` reaches the stored value.
+    map.find(5)->second = 6;
+    CHECK( *map.find(5)->first == 5 );
+    CHECK( as_const(map).find(5)->second == 6 );
+
     CHECK( map == map );
 }
 
@@ -80,3 +90,385 @@ TEST_CASE("copy")
     CHECK( map == copy_map );
     CHECK( copy_map == copy_map );
 }
+
+TEST_CASE("swiss table maps")
+{
+    weak_key_unordered_map<int, int, hash<int>, equal_to<>,
+                           allocator<weak_key_pair<int, int>>,
+                           swiss_policy> key_map;
+    weak_value_unordered_map<string, int, hash<string>, equal_to<>,
+                             allocator<weak_value_pair<string, int>>,
+                             swiss_policy> value_map;
+
+    auto five = make_shared<int>(5);
+    key_map[five] = 5;
+    value_map["five"] = five;
+    CHECK( key_map[five] == 5 );
+    CHECK( value_map.find("five") != value_map.end() );
+
+    five = nullptr;
+    CHECK( key_map.find(5) == key_map.end() );
+    CHECK( value_map.find("five") == value_map.end() );
+
+    five = make_shared<int>(5);
+    key_map[five] = 6;
+    value_map["five"] = five;
+    CHECK( key_map[five] == 6 );
+    CHECK( *value_map.find("five")->second == 5 );
+    CHECK( key_map.size() == 1 );
+    CHECK( value_map.size() == 1 );
+}
+
+TEST_CASE("incremental rehashing maps")
+{
+    weak_key_unordered_map<int, int> map;
+    map.rehash_step(2);
+
+    vector<shared_ptr<int>> keys;
+    for (int i = 0; i < 500; ++i) {
+        keys.push_back(make_shared<int>(i));
+        map[keys.back()] = i;
+        map[keys[i / 2]] += 1;
+    }
+
+    for (int i = 0; i < 500; ++i) {
+        CHECK( map[keys[i]] == i + (i < 250? 2 : 0) );
+    }
+
+    CHECK( map.size() == 500 );
+}
+
+TEST_CASE("make_tracked maps")
+{
+    weak_key_unordered_map<string, vector<int>> map;
+
+    auto hello = make_tracked<string>(map, "hello");
+    auto world = make_tracked<string>(map, "world");
+    map.insert({hello, vector<int>(1000)});
+    map[world].push_back(5);
+    CHECK( map.size() == 2 );
+
+    hello = nullptr;
+    map.insert({world, {6}});
+    CHECK( map.size() == 1 );
+    CHECK( (*map.find("world")).second == vector{6} );
+}
+
+namespace {
+
+// Counts how many keys get built, to check that transparent operations
+// only build one when they have to.
+struct counted_key
+{
+    static int built;
+
+    string text;
+
+    explicit counted_key(string_view sv) : text(sv) { ++built; }
+    counted_key(const counted_key& other) : text(other.text) { ++built; }
+    counted_key(counted_key&&) = default;
+    counted_key& operator=(const counted_key&) = default;
+    counted_key& operator=(counted_key&&) = default;
+
+    bool operator==(const counted_key& other) const
+    { return text == other.text; }
+};
+
+int counted_key::built = 0;
+
+struct key_hash
+{
+    using is_transparent = void;
+
+    size_t operator()(string_view sv) const
+    { return hash<string_view>()(sv); }
+
+    size_t operator()(const counted_key& key) const
+    { return (*this)(key.text); }
+};
+
+struct key_equal
+{
+    using is_transparent = void;
+
+    static string_view view(string_view sv) { return sv; }
+    static string_view view(const counted_key& key) { return key.text; }
+
+    template <class A, class B>
+    bool operator()(const A& a, const B& b) const
+    { return view(a) == view(b); }
+};
+
+template <class Policy>
+void check_transparent()
+{
+    weak_value_unordered_map<counted_key, int, key_hash, key_equal,
+                             allocator<counted_key>, Policy> map;
+    counted_key::built = 0;
+
+    auto one = make_shared<int>(1);
+    auto two = make_shared<int>(2);
+
+    map["one"sv] = one;
+    CHECK( counted_key::built == 1 );
+    CHECK( *map["one"sv] == 1 );
+    CHECK( map.member("one"sv) );
+    CHECK( counted_key::built == 1 );
+
+    auto [iter, inserted] = map.try_emplace("two"sv, two);
+    CHECK( inserted );
+    CHECK( *(*iter).second == 2 );
+    CHECK( counted_key::built == 2 );
+
+    tie(iter, inserted) = map.try_emplace("two"sv, one);
+    CHECK_FALSE( inserted );
+    CHECK( *(*iter).second == 2 );
+    CHECK( counted_key::built == 2 );
+
+    CHECK( map.erase("one"sv) );
+    CHECK_FALSE( map.erase("one"sv) );
+    CHECK_FALSE( map.member("one"sv) );
+    CHECK( counted_key::built == 2 );
+
+    // A key mapped to an expired value is there for the taking. (The
+    // iterator holds the value it points at, so let go of that first.)
+    iter = map.end();
+    two = nullptr;
+    tie(iter, inserted) = map.try_emplace("two"sv, one);
+    CHECK( inserted );
+    CHECK( *(*iter).second == 1 );
+}
+
+// A move-only mapped type that remembers how it was built.
+struct widget
+{
+    unique_ptr<int> number;
+    string name;
+
+    widget() : number(make_unique<int>(0)) { }
+    widget(int n, string s) : number(make_unique<int>(n)), name(move(s)) { }
+};
+
+template <class Policy>
+void check_emplace()
+{
+    weak_key_unordered_map<int, widget, hash<int>, equal_to<>,
+                           allocator<int>, Policy> map;
+
+    auto one = make_shared<const int>(1);
+    auto two = make_shared<const int>(2);
+
+    auto [iter, inserted] = map.try_emplace(one, 5, "five");
+    CHECK( inserted );
+    CHECK( *(*iter).second.number == 5 );
+    CHECK( (*iter).second.name == "five" );
+
+    tie(iter, inserted) = map.try_emplace(one, 6, "six");
+    CHECK_FALSE( inserted );
+    CHECK( *(*iter).second.number == 5 );
+
+    CHECK( *map[two].number == 0 );
+    map[two].name = "zero";
+
+    tie(iter, inserted) = map.insert_or_assign(two, widget(7, "seven"));
+    CHECK_FALSE( inserted );
+    CHECK( *(*iter).second.number == 7 );
+    CHECK( map.size() == 2 );
+
+    auto three = make_shared<const int>(3);
+    tie(iter, inserted) = map.insert_or_assign(three, widget(8, "eight"));
+    CHECK( inserted );
+    CHECK( map.size() == 3 );
+
+    auto four = make_shared<const int>(4);
+    map.emplace(move(four), widget(9, "nine"));
+    CHECK( map.size() == 4 );
+
+    // An expired key's bucket gets a freshly built value.
+    one = nullptr;
+    auto another_one = make_shared<const int>(1);
+    tie(iter, inserted) = map.try_emplace(another_one, 10, "ten");
+    CHECK( inserted );
+    CHECK( *map[another_one].number == 10 );
+
+    weak_weak_unordered_map<int, int, hash<int>, equal_to<>,
+                            allocator<int>, Policy> ww;
+    auto x = make_shared<int>(1);
+    auto y = make_shared<int>(2);
+    CHECK( ww.try_emplace(two, x).second );
+    CHECK_FALSE( ww.try_emplace(two, y).second );
+    CHECK( *ww[two] == 1 );
+    CHECK_FALSE( ww.insert_or_assign(two, y).second );
+    CHECK( *ww[two] == 2 );
+
+    weak_value_unordered_map<int, int, hash<int>, equal_to<>,
+                             allocator<int>, Policy> wv;
+    CHECK( wv.insert_or_assign(1, x).second );
+    CHECK_FALSE( wv.insert_or_assign(1, y).second );
+    CHECK( *wv[1] == 2 );
+}
+
+// Counts calls, to check that copying reuses the stored hash codes.
+struct counting_hash
+{
+    static int calls;
+
+    size_t operator()(const string& s) const
+    {
+        ++calls;
+        return hash<string>()(s);
+    }
+};
+
+int counting_hash::calls = 0;
+
+template <class Policy>
+void check_copy_without_rehashing()
+{
+    using map_t = weak_value_unordered_map<string, int, counting_hash,
+                                           equal_to<>, allocator<string>,
+                                           Policy>;
+
+    map_t map;
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100; ++z) {
+        holder.push_back(make_shared<int>(z));
+        map[to_string(z)] = holder.back();
+    }
+    for (int z = 0; z < 100; z += 4) {
+        holder[z] = nullptr;
+    }
+
+    counting_hash::calls = 0;
+
+    map_t copy(map);
+    CHECK( copy.bucket_count() == map.bucket_count() );
+
+    map_t assigned;
+    assigned = map;
+
+    // Into fewer buckets, which places each live element afresh.
+    map_t small;
+    small = map;
+    small.shrink_to_fit();
+    map_t from_small(small);
+    map_t assigned_small(small);
+    assigned_small = copy;
+
+    CHECK( counting_hash::calls == 0 );
+
+    CHECK( copy == map );
+    CHECK( assigned == map );
+    CHECK( from_small == map );
+    CHECK( assigned_small == map );
+
+    for (int z = 0; z < 100; ++z) {
+        CHECK( copy.member(to_string(z)) == (z % 4 != 0) );
+    }
+}
+
+}
+
+template <class Policy>
+void check_visit()
+{
+    weak_key_unordered_map<int, int, hash<int>, equal_to<>,
+                           allocator<int>, Policy> map;
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100; ++z) {
+        holder.push_back(make_shared<int>(z));
+        map[holder.back()] = z;
+    }
+
+    for (int z = 0; z < 100; z += 3) holder[z] = nullptr;
+
+    int visited = 0, sum = 0;
+    CHECK( map.for_each_live([&](const auto& view) {
+        ++visited;
+        sum += view.second;
+    }) );
+    CHECK( visited == 66 );
+    CHECK( sum == 4950 - 1683 );
+
+    visited = 0;
+    CHECK_FALSE( map.for_each_live([&](const auto&) {
+        return ++visited < 10;
+    }) );
+    CHECK( visited == 10 );
+
+    CHECK( map.with(5, [](const auto& view) { view.second = 50; }) );
+    CHECK( as_const(map).with(5, [](const auto& view) {
+        CHECK( *view.first == 5 );
+        CHECK( view.second == 50 );
+    }) );
+    CHECK_FALSE( map.with(6, [](const auto&) { FAIL(); }) );
+    CHECK_FALSE( map.with(100, [](const auto&) { FAIL(); }) );
+}
+
+TEST_CASE("visiting live elements")
+{
+    check_visit<default_table_policy>();
+    check_visit<swiss_policy>();
+
+    // Midway through an incremental rehash, the old buckets get visited
+    // too.
+    weak_weak_unordered_map<string, int> map;
+    map.rehash_step(1);
+    vector<shared_ptr<string>> keys;
+    vector<shared_ptr<int>> values;
+    for (int z = 0; z < 100; ++z) {
+        keys.push_back(make_shared<string>(to_string(z)));
+        values.push_back(make_shared<int>(z));
+        map[keys.back()] = values.back();
+    }
+
+    values[7] = nullptr;
+    int visited = 0;
+    map.for_each_live([&](const auto& view) {
+        ++visited;
+        CHECK( *view.first == to_string(*view.second) );
+    });
+    CHECK( visited == 99 );
+
+    for (int z = 0; z < 100; ++z) {
+        bool found = as_const(map).with(to_string(z), [&](const auto& view) {
+            CHECK( *view.second == z );
+        });
+        CHECK( found == (z != 7) );
+    }
+}
+
+TEST_CASE("copy without rehashing")
+{
+    check_copy_without_rehashing<default_table_policy>();
+    check_copy_without_rehashing<swiss_policy>();
+
+    // Midway through an incremental rehash, both sets of buckets get
+    // copied.
+    using map_t = weak_value_unordered_map<string, int, counting_hash>;
+    map_t map;
+    map.rehash_step(1);
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100; ++z) {
+        holder.push_back(make_shared<int>(z));
+        map[to_string(z)] = holder.back();
+    }
+
+    counting_hash::calls = 0;
+    map_t copy(map);
+    CHECK( counting_hash::calls == 0 );
+    CHECK( copy == map );
+    CHECK( copy.size() == 100 );
+}
+
+TEST_CASE("emplace")
+{
+    check_emplace<default_table_policy>();
+    check_emplace<swiss_policy>();
+}
+
+TEST_CASE("transparent operations")
+{
+    check_transparent<default_table_policy>();
+    check_transparent<swiss_policy>();
+}
@@ -58,6 +58,369 @@ TEST_CASE("growing")
     CHECK( set != weak_unordered_set<int>{} );
 }
 
+TEST_CASE("power-of-two indexing")
+{
+    using pow2_set = weak_unordered_set<int, hash<int>, equal_to<>,
+                                        allocator<int>, power_of_two_policy>;
+
+    vector<shared_ptr<int>> holder;
+    pow2_set set(5);
+    CHECK( set.bucket_count() == 8 );
+
+    for (int i = 0; i < 1000; ++i) {
+        auto new_ptr = make_shared<int>(i * 1024);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    size_t buckets = set.bucket_count();
+    CHECK( (buckets & (buckets - 1)) == 0 );
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i * 1024) );
+        CHECK_FALSE( set.member(i * 1024 + 1) );
+    }
+
+    for (int i = 0; i < 1000; i += 2) {
+        CHECK( set.erase(i * 1024) );
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i * 1024) == (i % 2 == 1) );
+    }
+}
+
+TEST_CASE("long probe sequences")
+{
+    // Every key collides, so most probe distances are too long to cache.
+    struct bad_hash
+    {
+        size_t operator()(int) const { return 7; }
+    };
+
+    vector<shared_ptr<int>> holder;
+    weak_unordered_set<int, bad_hash> set;
+
+    for (int i = 0; i < 600; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    for (int i = 0; i < 600; i += 3) {
+        CHECK( set.erase(i) );
+    }
+
+    for (int i = 1; i < 600; i += 3) {
+        holder[i] = nullptr;
+    }
+
+    set.insert(holder[0] = make_shared<int>(0));
+
+    for (int i = 0; i < 600; ++i) {
+        CHECK( set.member(i) == (i == 0 || i % 3 == 2) );
+    }
+}
+
+TEST_CASE("reinserting past an expired bucket")
+{
+    struct bad_hash
+    {
+        size_t operator()(int) const { return 3; }
+    };
+
+    weak_unordered_set<int, bad_hash> set;
+
+    auto one = make_shared<int>(1);
+    auto two = make_shared<int>(2);
+    auto three = make_shared<int>(3);
+    set.insert(one);
+    set.insert(two);
+    set.insert(three);
+
+    // Reinserting 3 must find it rather than reuse 1's bucket.
+    one = nullptr;
+    set.insert(make_shared<int>(3));
+    set.insert(three);
+
+    size_t threes = 0;
+    for (const auto& ptr : set)
+        if (*ptr == 3) ++threes;
+    CHECK( threes == 1 );
+
+    set.erase(3);
+    CHECK_FALSE( set.member(3) );
+    CHECK( set.member(2) );
+}
+
+TEST_CASE("swiss table")
+{
+    using swiss_set = weak_unordered_set<int, hash<int>, equal_to<>,
+                                         allocator<int>, swiss_policy>;
+
+    vector<shared_ptr<int>> holder;
+    swiss_set set;
+    CHECK( set.bucket_count() == 16 );
+
+    for (int i = 0; i < 1000; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    CHECK( 1000 == set.size() );
+    size_t buckets = set.bucket_count();
+    CHECK( (buckets & (buckets - 1)) == 0 );
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i) );
+        CHECK_FALSE( set.member(i + 1000) );
+    }
+
+    for (int i = 0; i < 1000; i += 2) {
+        CHECK( set.erase(i) );
+    }
+
+    CHECK( 500 == set.size() );
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i) == (i % 2 == 1) );
+    }
+
+    // Expired elements are skipped, then swept out.
+    for (int i = 1; i < 1000; i += 4) {
+        holder[i] = nullptr;
+    }
+
+    size_t count = 0;
+    for (const auto& ptr : set) {
+        CHECK( *ptr % 4 == 3 );
+        ++count;
+    }
+    CHECK( count == 250 );
+
+    set.remove_expired();
+    CHECK( 250 == set.size() );
+
+    // Reinserting reuses the buckets freed by erasing without growing.
+    for (int i = 0; i < 1000; i += 4) {
+        set.insert(holder[i] = make_shared<int>(i));
+    }
+    CHECK( set.bucket_count() == buckets );
+    CHECK( 500 == set.size() );
+
+    swiss_set copy(set);
+    CHECK( copy == set );
+    CHECK( copy != swiss_set{} );
+}
+
+template <class Set>
+void check_sweep_some()
+{
+    vector<shared_ptr<int>> holder;
+    Set set;
+
+    for (int i = 0; i < 1000; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    for (int i = 0; i < 1000; i += 2) {
+        holder[i] = nullptr;
+    }
+
+    size_t buckets = set.bucket_count();
+    size_t removed = 0;
+    for (size_t swept = 0; swept < buckets; swept += 100) {
+        removed += set.sweep_some(100);
+        CHECK( set.size() == 1000 - removed );
+    }
+
+    CHECK( removed == 500 );
+    CHECK( set.sweep_some(buckets) == 0 );
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i) == (i % 2 == 1) );
+    }
+}
+
+TEST_CASE("sweep_some")
+{
+    check_sweep_some<weak_unordered_set<int>>();
+    check_sweep_some<weak_unordered_set<int, hash<int>, equal_to<>,
+                                        allocator<int>, swiss_policy>>();
+}
+
+TEST_CASE("sweep_some past shifted elements")
+{
+    // Every key collides, so erasing shifts the rest of the run back.
+    struct bad_hash
+    {
+        size_t operator()(int) const { return 7; }
+    };
+
+    vector<shared_ptr<int>> holder;
+    weak_unordered_set<int, bad_hash> set;
+    set.min_load_factor(0);
+
+    for (int i = 0; i < 100; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    // Expire neighbors in pairs, so each erase shifts an expired element
+    // into the bucket just swept.
+    for (int i = 0; i < 100; ++i) {
+        if (i % 4 < 2) holder[i] = nullptr;
+    }
+
+    size_t buckets = set.bucket_count();
+    size_t removed = 0;
+    for (size_t swept = 0; swept < buckets; swept += 10) {
+        removed += set.sweep_some(std::min(size_t(10), buckets - swept));
+    }
+
+    CHECK( removed == 50 );
+    CHECK( set.size() == 50 );
+}
+
+TEST_CASE("incremental rehashing")
+{
+    vector<shared_ptr<int>> holder;
+    weak_unordered_set<int> set;
+    set.rehash_step(1);
+
+    for (int i = 0; i < 1000; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+
+        // Reinserting finds the element, wherever it is.
+        size_t size = set.size();
+        set.insert(new_ptr);
+        CHECK( set.size() <= size );
+
+        if (i % 10 == 0 && i > 0) {
+            holder[i / 2] = nullptr;
+            CHECK( set.erase(i / 3) == (holder[i / 3] != nullptr) );
+            set.insert(holder[i / 3] = make_shared<int>(i / 3));
+            CHECK( set.find(i / 3) != set.end() );
+        }
+
+        if (i % 97 == 0) {
+            for (const auto& ptr : set) {
+                CHECK( holder[*ptr] == ptr );
+            }
+            for (int j = 0; j <= i; ++j) {
+                CHECK( set.member(j) == (holder[j] != nullptr) );
+            }
+        }
+    }
+
+    size_t live = 0;
+    for (const auto& ptr : holder) live += ptr != nullptr;
+
+    size_t count = 0;
+    for (const auto& ptr : set) {
+        CHECK( holder[*ptr] == ptr );
+        ++count;
+    }
+    CHECK( count == live );
+
+    set.rehash_step(0);
+    set.remove_expired();
+    CHECK( set.size() == live );
+
+    for (int i = 0; i < 1000; ++i) {
+        CHECK( set.member(i) == (holder[i] != nullptr) );
+    }
+}
+
+template <class Set>
+void check_shrinking()
+{
+    vector<shared_ptr<int>> holder;
+    Set set;
+
+    for (int i = 0; i < 10000; ++i) {
+        auto new_ptr = make_shared<int>(i);
+        holder.push_back(new_ptr);
+        set.insert(new_ptr);
+    }
+
+    size_t full_buckets = set.bucket_count();
+
+    for (int i = 100; i < 10000; ++i) {
+        holder[i] = nullptr;
+    }
+
+    set.remove_expired();
+    size_t shrunk_buckets = set.bucket_count();
+    CHECK( shrunk_buckets < full_buckets / 10 );
+    CHECK( set.load_factor() >= set.min_load_factor() );
+    CHECK( set.load_factor() <= set.max_load_factor() );
+
+    for (int i = 0; i < 10000; ++i) {
+        CHECK( set.member(i) == (i < 100) );
+    }
+
+    // Hysteresis: small changes either way leave it alone.
+    for (int i = 0; i < 10; ++i) {
+        CHECK( set.erase(i) );
+    }
+    for (int i = 0; i < 10; ++i) {
+        set.insert(holder[i]);
+    }
+    CHECK( set.bucket_count() == shrunk_buckets );
+
+    set.reserve(10000);
+    CHECK( set.bucket_count() > full_buckets / 2 );
+    set.shrink_to_fit();
+    CHECK( set.bucket_count() <= shrunk_buckets );
+    CHECK( set.size() == 100 );
+
+    Set unshrinking;
+    unshrinking.min_load_factor(0);
+    unshrinking.reserve(10000);
+    size_t reserved_buckets = unshrinking.bucket_count();
+    unshrinking.insert(holder[0]);
+    unshrinking.erase(0);
+    CHECK( unshrinking.bucket_count() == reserved_buckets );
+
+    // A table sized up front stays that size while it fills, whether it
+    // was sized by the constructor or by `reserve`.
+    Set constructed(1 << 12);
+    size_t constructed_buckets = constructed.bucket_count();
+    Set presized(1 << 16);
+    presized.reserve(50000);
+    size_t presized_buckets = presized.bucket_count();
+    for (int i = 0; i < 100; ++i) {
+        constructed.insert(holder[i]);
+        presized.insert(holder[i]);
+    }
+    CHECK( constructed.erase(5) );
+    CHECK( presized.erase(5) );
+    presized.remove_expired();
+    presized.sweep_some(100);
+    CHECK( constructed.bucket_count() == constructed_buckets );
+    CHECK( presized.bucket_count() == presized_buckets );
+
+    // Until `shrink_to_fit` lets go of the reservation.
+    presized.shrink_to_fit();
+    CHECK( presized.bucket_count() < presized_buckets / 100 );
+}
+
+TEST_CASE("shrinking")
+{
+    check_shrinking<weak_unordered_set<int>>();
+    check_shrinking<weak_unordered_set<int, hash<int>, equal_to<>,
+                                       allocator<int>, power_of_two_policy>>();
+    check_shrinking<weak_unordered_set<int, hash<int>, equal_to<>,
+                                       allocator<int>, swiss_policy>>();
+}
+
+template <class Policy = default_table_policy>
 class SetTester
 {
 public:
@@ -118,12 +481,12 @@ private:
     };
 
     unordered_set<shared_ptr<int>, Hash, EqualTo> holder_;
-    weak_unordered_set<int, Hash> set_;
+    weak_unordered_set<int, Hash, equal_to<>, allocator<int>, Policy> set_;
 };
 
 TEST_CASE("erase")
 {
-    SetTester tester;
+    SetTester<> tester;
 
     for (int z = 0; z < 20; ++z) {
         tester.insert(z);
@@ -153,3 +516,500 @@ TEST_CASE("erase")
         CHECK( tester.member(z) );
     }
 }
+
+TEST_CASE("swiss table erase")
+{
+    SetTester<swiss_policy> tester;
+
+    for (int z = 0; z < 100; ++z) {
+        tester.insert(z);
+    }
+
+    for (int z = 0; z < 100; z += 3) {
+        tester.erase(z);
+    }
+
+    for (int z = 1; z < 100; z += 3) {
+        tester.forget(z);
+    }
+
+    for (int z = 0; z < 100; ++z) {
+        CHECK( tester.member(z) == (z % 3 == 2) );
+    }
+
+    for (int z = 0; z < 100; z += 3) {
+        tester.insert(z);
+    }
+
+    for (int z : tester.members()) {
+        CHECK( tester.member(z) );
+    }
+}
+
+TEST_CASE("make_tracked")
+{
+    weak_unordered_set<int> set;
+
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100; ++z) {
+        holder.push_back(make_tracked<int>(set, z));
+        set.insert(holder.back());
+    }
+
+    CHECK( set.size() == 100 );
+
+    // Untracked elements wait for a sweep.
+    auto untracked = make_shared<int>(1000);
+    set.insert(untracked);
+    untracked = nullptr;
+
+    for (int z = 0; z < 100; z += 2) {
+        holder[z] = nullptr;
+    }
+
+    CHECK( set.size() == 101 );
+    CHECK_FALSE( set.erase(1000) );
+    CHECK( set.size() == 51 );
+
+    for (int z = 0; z < 100; ++z) {
+        CHECK( set.member(z) == (z % 2 == 1) );
+    }
+
+    // A tracked pointer may outlive its table.
+    auto survivor = make_tracked<int>(set, 700);
+    {
+        weak_unordered_set<int> moved(std::move(set));
+        moved.insert(survivor);
+        CHECK( moved.size() == 52 );
+        holder.clear();
+        moved.insert(survivor);
+        CHECK( moved.size() == 2 );
+    }
+    survivor = nullptr;
+}
+
+template <class Policy>
+void check_bulk_insert()
+{
+    using set_t = weak_unordered_set<int, hash<int>, equal_to<>,
+                                     allocator<int>, Policy>;
+
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 1000; ++z) {
+        holder.push_back(make_shared<int>(z));
+    }
+
+    // Into an empty table, which makes room for all of them at once.
+    set_t set(holder.begin(), holder.end());
+    CHECK( set.size() == 1000 );
+    CHECK( set.load_factor() <= set.max_load_factor() );
+    for (int z = 0; z < 1000; ++z) {
+        CHECK( set.member(z) );
+    }
+
+    // Into a non-empty table, past some expired elements, with duplicates.
+    vector<shared_ptr<int>> more;
+    for (int z = 500; z < 2000; ++z) {
+        more.push_back(z < 1000? holder[z] : make_shared<int>(z));
+    }
+    for (int z = 0; z < 1000; z += 2) {
+        holder[z] = nullptr;
+    }
+
+    set.insert(more.begin(), more.end());
+    for (int z = 0; z < 2000; ++z) {
+        CHECK( set.member(z) == (z >= 500 || z % 2 == 1) );
+    }
+    set.remove_expired();
+    CHECK( set.size() == 1750 );
+
+    // Equal keys in one range: the last one wins.
+    auto first = make_shared<int>(5000);
+    auto last = make_shared<int>(5000);
+    vector<shared_ptr<int>> twins{first, last};
+    set_t fresh;
+    fresh.insert(twins.begin(), twins.end());
+    CHECK( fresh.size() == 1 );
+    CHECK( *fresh.begin() == last );
+}
+
+TEST_CASE("bulk insert")
+{
+    check_bulk_insert<default_table_policy>();
+    check_bulk_insert<power_of_two_policy>();
+    check_bulk_insert<swiss_policy>();
+}
+
+template <class Policy>
+void check_lookup_many()
+{
+    weak_unordered_set<int, hash<int>, equal_to<>,
+                       allocator<int>, Policy> set;
+
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+    }
+    for (int z = 0; z < 100; z += 3) {
+        holder[z] = nullptr;
+    }
+
+    // More keys than fit in one batch, some never inserted.
+    vector<int> keys;
+    for (int z = 0; z < 150; ++z) {
+        keys.push_back(z);
+    }
+
+    vector<bool> members;
+    set.member_many(keys.begin(), keys.end(), back_inserter(members));
+    REQUIRE( members.size() == keys.size() );
+
+    vector<decltype(set.cbegin())> found;
+    as_const(set).find_many(keys.begin(), keys.end(), back_inserter(found));
+    REQUIRE( found.size() == keys.size() );
+
+    vector<decltype(set.begin())> found_mutable(keys.size(), set.end());
+    auto end = set.find_many(keys.begin(), keys.end(), found_mutable.begin());
+    CHECK( end == found_mutable.end() );
+
+    for (int z = 0; z < 150; ++z) {
+        bool expected = z < 100 && z % 3 != 0;
+        CHECK( members[z] == expected );
+        CHECK( (found[z] != set.cend()) == expected );
+        CHECK( (found_mutable[z] != set.end()) == expected );
+        if (expected) {
+            CHECK( **found[z] == z );
+            CHECK( **found_mutable[z] == z );
+        }
+    }
+}
+
+TEST_CASE("lookup many")
+{
+    check_lookup_many<default_table_policy>();
+    check_lookup_many<power_of_two_policy>();
+    check_lookup_many<swiss_policy>();
+}
+
+template <class Policy>
+void check_iterator_holds_element()
+{
+    using set_t = weak_unordered_set<int, hash<int>, equal_to<>,
+                                     allocator<int>, Policy>;
+
+    auto one = make_shared<int>(1);
+    auto two = make_shared<int>(2);
+    set_t set;
+    set.insert(one);
+    set.insert(two);
+
+    // The iterator locked its element once, on arrival, and still holds it
+    // after the owner lets go.
+    auto iter = set.begin();
+    weak_ptr<const int> held = *iter;
+    CHECK( iter->use_count() == 2 );
+    (held.lock() == one? one : two) = nullptr;
+    CHECK_FALSE( held.expired() );
+    CHECK( *iter == held.lock() );
+
+    typename set_t::const_iterator citer = iter;
+    CHECK( *citer == *iter );
+
+    ++iter;
+    ++citer;
+    CHECK( held.expired() );
+    CHECK( iter != set.end() );
+    CHECK( ++iter == set.end() );
+    CHECK( ++citer == set.cend() );
+}
+
+TEST_CASE("iterators hold their element")
+{
+    check_iterator_holds_element<default_table_policy>();
+    check_iterator_holds_element<swiss_policy>();
+}
+
+// Sends runs of sixteen keys to the same bucket, so that the table has
+// long runs for parallel sweeps to keep whole.
+struct clumpy_hash
+{
+    size_t operator()(int z) const { return size_t(z / 16); }
+};
+
+template <class Policy>
+void check_parallel_remove_expired()
+{
+    using set_t = weak_unordered_set<int, clumpy_hash, equal_to<>,
+                                     allocator<int>, Policy>;
+
+    // Runs the tasks one at a time, backward, on the calling thread.
+    auto backward = [](size_t tasks, auto& task) {
+        for (size_t i = tasks; i-- > 0; ) task(i);
+    };
+
+    for (size_t tasks : {1, 3, 8, 64}) {
+        vector<shared_ptr<int>> holder;
+        set_t set;
+        for (int z = 0; z < 1000; ++z) {
+            holder.push_back(make_shared<int>(z));
+            set.insert(holder.back());
+        }
+
+        size_t live = 0;
+        for (int z = 0; z < 1000; ++z) {
+            if (z % 3 == 0 || (z / 100) % 2 == 0) holder[z] = nullptr;
+            live += holder[z] != nullptr;
+        }
+
+        if (tasks % 2) set.remove_expired(tasks);
+        else set.remove_expired(tasks, backward);
+
+        CHECK( set.size() == live );
+        for (int z = 0; z < 1000; ++z) {
+            CHECK( set.member(z) == (holder[z] != nullptr) );
+        }
+    }
+}
+
+TEST_CASE("parallel remove_expired")
+{
+    check_parallel_remove_expired<default_table_policy>();
+    check_parallel_remove_expired<power_of_two_policy>();
+    check_parallel_remove_expired<swiss_policy>();
+
+    // Midway through an incremental rehash, the old buckets get swept too.
+    vector<shared_ptr<int>> holder;
+    weak_unordered_set<int> set;
+    set.rehash_step(1);
+    for (int z = 0; z < 1000; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+    }
+    for (int z = 0; z < 1000; z += 2) holder[z] = nullptr;
+
+    set.remove_expired(4);
+    CHECK( set.size() == 500 );
+    for (int z = 0; z < 1000; ++z) {
+        CHECK( set.member(z) == (z % 2 == 1) );
+    }
+}
+
+// Sends runs of four keys to every seventh bucket, so that some runs
+// straddle the ranges that a parallel resize splits the buckets into.
+struct spaced_clumpy_hash
+{
+    size_t operator()(int z) const { return size_t(z / 4 * 7); }
+};
+
+template <class Hash, class Policy>
+void check_parallel_resize()
+{
+    using set_t = weak_unordered_set<int, Hash, equal_to<>,
+                                     allocator<int>, Policy>;
+
+    set_t set;
+    set.resize_threads(4);
+    CHECK( set.resize_threads() == 4 );
+
+    // Growing past the threshold for going parallel, with some elements
+    // expiring along the way.
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 100000; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+        if (z % 7 == 0) holder[z / 2] = nullptr;
+    }
+
+    set.reserve(200000);
+
+    auto check_contents = [&] {
+        size_t live = 0;
+        for (int z = 0; z < 100000; ++z) {
+            bool expected = holder[z] != nullptr;
+            live += expected;
+            if (set.member(z) != expected) {
+                FAIL( "wrong membership for " << z );
+            }
+        }
+
+        size_t count = 0;
+        for (const auto& ptr : set) {
+            CHECK( holder[*ptr] == ptr );
+            ++count;
+        }
+        CHECK( count == live );
+    };
+
+    check_contents();
+
+    // And shrinking, once most have expired.
+    for (int z = 0; z < 100000; ++z) {
+        if (z % 10 != 0) holder[z] = nullptr;
+    }
+    set_t copy(set);
+    CHECK( copy.resize_threads() == 4 );
+    set.shrink_to_fit();
+    check_contents();
+}
+
+TEST_CASE("parallel resize")
+{
+    check_parallel_resize<hash<int>, default_table_policy>();
+    check_parallel_resize<hash<int>, power_of_two_policy>();
+    check_parallel_resize<spaced_clumpy_hash, default_table_policy>();
+    check_parallel_resize<spaced_clumpy_hash, power_of_two_policy>();
+}
+
+TEST_CASE("table stats")
+{
+    // Every key collides, so each probe goes one bucket further.
+    struct bad_hash
+    {
+        size_t operator()(int) const { return 3; }
+    };
+
+    using set_t = weak_unordered_set<int, bad_hash, equal_to<>,
+                                     allocator<int>, counting_policy>;
+
+    set_t set;
+    auto one = make_shared<int>(1);
+    auto two = make_shared<int>(2);
+    auto three = make_shared<int>(3);
+    set.insert(one);
+    set.insert(two);
+    set.insert(three);
+
+    table_stats stats = set.stats();
+    CHECK( stats.insert_probes[0] == 1 );
+    CHECK( stats.insert_probes[1] == 1 );
+    CHECK( stats.insert_probes[2] == 1 );
+    CHECK( stats.locks == 3 );
+
+    CHECK( set.member(2) );
+    CHECK_FALSE( set.member(4) );
+    one = nullptr;
+    CHECK( set.member(3) );
+
+    stats = set.stats();
+    CHECK( stats.lookup_probes[1] == 1 );
+    CHECK( stats.lookup_probes[2] == 1 );
+    CHECK( stats.lookup_probes[3] == 1 );
+    CHECK( stats.locks == 3 + 2 + 3 + 3 );
+    CHECK( stats.expired_probed == 1 );
+
+    // Erasing 2 shifts 3 back, and sweeping out 1 shifts it home.
+    CHECK( set.erase(2) );
+    set.remove_expired();
+    stats = set.stats();
+    CHECK( stats.expired_probed == 2 );
+    CHECK( stats.shifts == 2 );
+    CHECK( stats.sweeps == 1 );
+    CHECK( stats.reclaimed == 1 );
+    CHECK( stats.resizes == 0 );
+
+    set.reserve(100);
+    CHECK( set.stats().resizes == 1 );
+    CHECK( set.stats().sweeps == 2 );
+
+    // Copies start over, while moves take the counts along.
+    set_t copy(set);
+    CHECK( copy.stats().resizes == 0 );
+    set_t moved(std::move(set));
+    CHECK( moved.stats().resizes == 1 );
+
+    moved.reset_stats();
+    CHECK( moved.stats().resizes == 0 );
+    CHECK( moved.stats().locks == 0 );
+
+    // Midway through an incremental rehash, the old buckets' counts show
+    // too, and they're kept once the migration is done.
+    moved.rehash_step(1);
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 200; ++z) {
+        holder.push_back(make_shared<int>(z + 10));
+        moved.insert(holder.back());
+    }
+    size_t probes = 0;
+    for (size_t count : moved.stats().insert_probes) probes += count;
+    CHECK( probes == 200 );
+    size_t shifts = moved.stats().shifts;
+    moved.rehash_step(0);
+    CHECK( moved.stats().shifts >= shifts );
+    CHECK( moved.stats().resizes > 0 );
+
+    // Without a counting policy, there's nothing to see.
+    weak_unordered_set<int> plain;
+    plain.insert(three);
+    CHECK( plain.member(3) );
+    CHECK( plain.stats().locks == 0 );
+}
+
+template <class Growth>
+struct counting_growth_policy : counting_policy
+{
+    using growth = Growth;
+};
+
+template <class Growth>
+using growth_set_t = weak_unordered_set<int, hash<int>, equal_to<>,
+                                        allocator<int>,
+                                        counting_growth_policy<Growth>>;
+
+template <class Growth>
+size_t sweeps_to_grow_to(int count)
+{
+    vector<shared_ptr<int>> holder;
+    growth_set_t<Growth> set;
+    for (int z = 0; z < count; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+    }
+    return set.stats().sweeps;
+}
+
+template <class Growth>
+size_t buckets_after_nearly_fruitless_sweep()
+{
+    // Just past the maximum load factor, with one element expired.
+    vector<shared_ptr<int>> holder;
+    growth_set_t<Growth> set(100);
+    for (int z = 0; z < 81; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+    }
+    CHECK( set.bucket_count() == 100 );
+
+    holder[0] = nullptr;
+    auto last = make_shared<int>(81);
+    set.insert(last);
+    CHECK( set.stats().reclaimed == 1 );
+    return set.bucket_count();
+}
+
+TEST_CASE("growth policies")
+{
+    // When nothing expires, low churn growth stops sweeping before growing.
+    size_t doubling_sweeps = sweeps_to_grow_to<doubling_growth>(5000);
+    size_t low_churn_sweeps = sweeps_to_grow_to<low_churn_growth>(5000);
+    CHECK( low_churn_sweeps > 0 );
+    CHECK( low_churn_sweeps < doubling_sweeps );
+
+    // High churn growth doesn't settle for a sweep that frees one bucket.
+    CHECK( buckets_after_nearly_fruitless_sweep<doubling_growth>() == 100 );
+    CHECK( buckets_after_nearly_fruitless_sweep<high_churn_growth>() == 200 );
+
+    // Compact growth grows by half (2, 4, 7, 11, 17), and shrinks further.
+    growth_set_t<compact_growth> set(2);
+    vector<shared_ptr<int>> holder;
+    for (int z = 0; z < 10; ++z) {
+        holder.push_back(make_shared<int>(z));
+        set.insert(holder.back());
+    }
+    CHECK( set.bucket_count() == 17 );
+
+    holder.clear();
+    set.remove_expired();
+    CHECK( set.empty() );
+    CHECK( set.bucket_count() == 2 );
+}